@@ -0,0 +1,103 @@
+// Compact binary capture output.
+//
+// HEX mode sends at least six characters for every 9 bit word. Binary mode packs the words
+// into frames instead, so the console can keep up with a much busier BUS:
+//
+//   0xA5                      sync
+//   type<<4 | count           type 0 = BUS words, 1 = BUS words with timestamps
+//                             count = 1 to 8 words
+//   4 bytes                   type 1 only: arrival time of the first word in microseconds
+//   (9 * count + 7) / 8       the words, 9 bits each, least significant bit first
+//   2 * (count - 1) bytes     type 1 only: microseconds from each word to the next
+//   checksum                  makes the sum of everything after the sync byte zero
+//
+// Multi-byte values are sent least significant byte first. A full frame carries 8 words
+// in 12 bytes, or 30 bytes with timestamps. Frames are sent when 8 words have been
+// collected or, via bin_flush(), when both the receive buffer and the console transmit
+// buffer run empty, so that frames stay full whenever the console is the bottleneck.
+// host/wwbindec.c turns a binary capture back into the HEX mode listing.
+
+#include <stdio.h>
+#include "hal.h"
+#include "wwproto.h"
+#include "uart12.h"
+#include "binout.h"
+
+bit bin_timestamps = 0;                 // TRUE to send BINSTAMPED frames
+
+static unsigned int xdata words[BINMAXWORDS];  // words waiting to be sent
+static unsigned int xdata gaps[BINMAXWORDS-1]; // microseconds from each word to the next
+static unsigned long xdata first;       // arrival time of the first word
+static unsigned long xdata last;        // and of the last
+static unsigned char count = 0;
+static bit stamped;                     // the words waiting are for a BINSTAMPED frame
+static unsigned char checksum;
+
+//------------------------------------------------------------------------------------------
+// sends one byte of a frame and adds it to the checksum.
+//------------------------------------------------------------------------------------------
+static void bin_byte(unsigned char c) {
+    putchar(c);
+    checksum += c;
+}
+
+//------------------------------------------------------------------------------------------
+// sends the words collected so far as one frame.
+//------------------------------------------------------------------------------------------
+void bin_flush(void) {
+    unsigned char i,nbits;
+    unsigned int bits;
+
+    if (!count) return;
+
+    putchar(BINSYNC);
+    checksum = 0;
+    bin_byte(((stamped ? BINSTAMPED : BINWORDS)<<4)|count);
+    if (stamped) {
+       bin_byte(first);
+       bin_byte(first>>8);
+       bin_byte(first>>16);
+       bin_byte(first>>24);
+    }
+
+    bits = 0;
+    nbits = 0;
+    for (i = 0; i < count; i++) {
+       bits |= words[i]<<nbits;         // nbits is less than 8, so the 9 new bits still fit
+       nbits += 9;
+       while (nbits >= 8) {
+          bin_byte(bits);
+          bits >>= 8;
+          nbits -= 8;
+       }
+    }
+    if (nbits)                          // the last partly filled byte
+       bin_byte(bits);
+
+    if (stamped) {
+       for (i = 0; i < count-1; i++) {
+          bin_byte(gaps[i]);
+          bin_byte(gaps[i]>>8);
+       }
+    }
+    putchar(-checksum);
+    count = 0;
+}
+
+//------------------------------------------------------------------------------------------
+// adds one BUS word that arrived at time 't' to the frame being collected, sending the
+// frame when it is full.
+//------------------------------------------------------------------------------------------
+void bin_put(unsigned int w, unsigned long t) {
+    if (count && (stamped != bin_timestamps || (bin_timestamps && t - last > 0xFFFF)))
+       bin_flush();                     // this word can't go in the same frame
+    stamped = bin_timestamps;
+    words[count] = w & 0x1FF;
+    if (count)
+       gaps[count-1] = t - last;        // fits, see above
+    else
+       first = t;
+    last = t;
+    if (++count == BINMAXWORDS)
+       bin_flush();
+}
@@ -0,0 +1,16 @@
+// Compact binary capture output. See binout.c for the frame format.
+
+#ifndef BINOUT_H
+#define BINOUT_H
+
+#define BINSYNC     0xA5                // first byte of every frame
+#define BINWORDS    0x00                // frame type: packed 9 bit BUS words
+#define BINSTAMPED  0x01                // frame type: packed 9 bit BUS words with timestamps
+#define BINMAXWORDS 8                   // words in a full frame, 8 words pack into 9 bytes
+
+void bin_put(unsigned int w, unsigned long t);
+void bin_flush(void);
+
+extern bit bin_timestamps;              // TRUE to send BINSTAMPED frames
+
+#endif
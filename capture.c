@@ -0,0 +1,239 @@
+// Burst capture to internal MOVX SRAM.
+//
+// The console is much slower than the BUS, so a long burst of BUS traffic overflows the
+// live output. In capture mode the words go into a buffer in MOVX SRAM instead, and are
+// sent to the console later, in whatever output mode is selected, when asked for.
+//
+// Each word is stored with the time since the word before it, in units of 4 microseconds:
+//
+//   byte 0          bits 7-0 of the word
+//   byte 1          bit 7 = bit 8 of the word, bits 6-0 = gap, 0x7F = gap follows
+//   bytes 2, 3      only if byte 1 bits 6-0 are 0x7F: the gap, least significant byte first
+//
+// so BUS bursts take 2 bytes per word and pauses of more than half a millisecond take 4.
+// Gaps longer than 262 milliseconds are recorded as 262 milliseconds. The time of the
+// first word is kept separately.
+//
+// With a trigger set (see trigger.c) "capture start" arms the capture instead. The words
+// still go into the buffer, but it is used as a ring: the oldest command is dropped to
+// make room for a new one, and to keep no more than trigger_pre commands ahead of the
+// one being received. Room is left at the end for the command that fires the trigger and
+// the trigger_post after it, as far as the buffer allows. When the trigger fires the capture carries on as usual for
+// trigger_post more commands, or until the buffer fills, and then stops. A command
+// starts at an address word, so the Printer Board's responses go with the command before.
+
+#include <stdio.h>
+#include "hal.h"
+#include "capture.h"
+#include "trigger.h"
+
+#define FALSE 0
+#define TRUE  1
+
+#define CAPSIZE   256                   // size of the capture buffer in bytes, positions in it wrap around in an unsigned char
+#define GAPESCAPE 0x7F                  // byte 1 value meaning a 16 bit gap follows
+#define CMDBYTES  8                     // bytes a four word command takes in a burst
+
+// kept across a watchdog reset, see capture_resume()
+unsigned char xdata NOINIT capture_state;
+static unsigned char xdata NOINIT capbuf[CAPSIZE];
+static unsigned int xdata NOINIT caplen;        // bytes used in capbuf
+static unsigned int xdata NOINIT capwords;      // words in capbuf
+static unsigned long xdata NOINIT capfirst;     // time of the first word
+static unsigned long xdata NOINIT caplast;      // time of the word last stored or returned
+static unsigned char xdata NOINIT capfull;      // a word didn't fit
+static unsigned char xdata NOINIT capstart;     // where in capbuf the first word is
+static unsigned char xdata NOINIT capcommands;  // address words in capbuf
+static unsigned char xdata NOINIT captrig;      // the trigger has fired
+static unsigned char xdata NOINIT cappost;      // commands still to capture after the trigger
+
+#define CAPBYTE(i) capbuf[(unsigned char)(capstart+(i))]  // byte 'i' of the capture, counting from the first word
+
+static unsigned int cappos;             // capture_get() position in capbuf
+
+//------------------------------------------------------------------------------------------
+// empties the capture buffer, capture off.
+//------------------------------------------------------------------------------------------
+void capture_init(void) {
+    caplen = 0;
+    capwords = 0;
+    capstart = 0;
+    capcommands = 0;
+    capfull = FALSE;
+    captrig = FALSE;
+    capture_state = CAPTURE_OFF;
+}
+
+//------------------------------------------------------------------------------------------
+// after a watchdog reset, keeps what was captured and carries on capturing if it was. a
+// dump that was going on is stopped, "capture dump" starts it again, and so is a capture
+// waiting for the trigger, which the reset has cleared. returns FALSE if the capture
+// buffer doesn't make sense, and capture_init() must be called instead.
+//------------------------------------------------------------------------------------------
+bit capture_resume(void) {
+    if (caplen > CAPSIZE || capwords > caplen/2 || capcommands > capwords || capture_state > CAPTURE_ARMED)
+       return (FALSE);
+    if (capture_state == CAPTURE_DUMP || capture_state == CAPTURE_ARMED)
+       capture_state = CAPTURE_OFF;
+    return (TRUE);
+}
+
+//------------------------------------------------------------------------------------------
+// empties the capture buffer and starts capturing BUS words, or waiting for the trigger
+// if there is one.
+//------------------------------------------------------------------------------------------
+void capture_start(void) {
+    caplen = 0;
+    capwords = 0;
+    capstart = 0;
+    capcommands = 0;
+    capfull = FALSE;
+    captrig = FALSE;
+    if (trigger_steps) {
+       trigger_arm();
+       capture_state = CAPTURE_ARMED;
+    }
+    else
+       capture_state = CAPTURE_ON;
+}
+
+//------------------------------------------------------------------------------------------
+// stops capturing or dumping. the capture buffer is kept.
+//------------------------------------------------------------------------------------------
+void capture_stop(void) {
+    capture_state = CAPTURE_OFF;
+}
+
+//------------------------------------------------------------------------------------------
+// starts sending the capture buffer to the console, see capture_get().
+//------------------------------------------------------------------------------------------
+void capture_dump(void) {
+    cappos = 0;
+    capture_state = CAPTURE_DUMP;
+}
+
+//------------------------------------------------------------------------------------------
+// drops the oldest word from the capture buffer, and the rest of its command.
+//------------------------------------------------------------------------------------------
+static void drop_command(void) {
+    unsigned int gap;
+    unsigned char c;
+
+    do {
+       c = CAPBYTE(1);
+       gap = c & GAPESCAPE;
+       if (gap == GAPESCAPE)
+          gap = CAPBYTE(2) | (unsigned int)CAPBYTE(3) << 8;
+       capfirst += (unsigned long)gap << 2;     // the time of the word that is first now, less its own gap
+       if (c & 0x80) --capcommands;
+       capstart += gap < GAPESCAPE ? 2 : 4;
+       caplen -= gap < GAPESCAPE ? 2 : 4;
+       --capwords;
+    } while (capwords && !(CAPBYTE(1) & 0x80));
+}
+
+//------------------------------------------------------------------------------------------
+// returns the bytes of the capture buffer used for the commands from before the trigger,
+// the rest is kept for the commands from after.
+//------------------------------------------------------------------------------------------
+static unsigned int armed_size(void) {
+    unsigned int after = (trigger_post+1) * CMDBYTES;
+
+    if (after > CAPSIZE - CMDBYTES)
+       return (CMDBYTES);
+    return (CAPSIZE - after);
+}
+
+//------------------------------------------------------------------------------------------
+// stores a BUS word that arrived at time 't'. returns FALSE, and stops capturing, if the
+// capture buffer is full or the commands after the trigger have all been captured.
+//------------------------------------------------------------------------------------------
+bit capture_put(unsigned int w, unsigned long t) {
+    unsigned long gap;
+
+    if (w & 0x100) {                    // a new command...
+       if (capture_state == CAPTURE_ARMED) {
+          if (capwords && !(CAPBYTE(1) & 0x80))
+             drop_command();            // ...the words from before the first one aren't a command
+          while (capcommands > trigger_pre)
+             drop_command();            // ...only trigger_pre of them are wanted
+       }
+       else if (captrig && !cappost--) {
+          capture_state = CAPTURE_OFF;  // ...and the last one after the trigger is finished
+          return (FALSE);
+       }
+    }
+
+    if (!capwords) {
+       capfirst = t;
+       caplast = t;
+    }
+    gap = (t - caplast) >> 2;           // in units of 4 microseconds
+    if (gap > 0xFFFF) {                 // a long pause, the rest of it is lost
+       gap = 0xFFFF;
+       caplast = t - (gap << 2);
+    }
+
+    while (capture_state == CAPTURE_ARMED && capwords && caplen + (gap < GAPESCAPE ? 2 : 4) > armed_size())
+       drop_command();                  // make room, 'gap' is still right, see drop_command()
+    if (caplen + (gap < GAPESCAPE ? 2 : 4) > CAPSIZE) {
+       capfull = TRUE;
+       capture_state = CAPTURE_OFF;
+       return (FALSE);
+    }
+    CAPBYTE(caplen++) = w;
+    if (gap < GAPESCAPE) {
+       CAPBYTE(caplen++) = (w & 0x100 ? 0x80 : 0) | gap;
+    }
+    else {
+       CAPBYTE(caplen++) = (w & 0x100 ? 0x80 : 0) | GAPESCAPE;
+       CAPBYTE(caplen++) = gap;
+       CAPBYTE(caplen++) = gap >> 8;
+    }
+    caplast += gap << 2;                // not 't', so the rounding doesn't add up over the capture
+    ++capwords;
+    if (w & 0x100) ++capcommands;
+
+    if (capture_state == CAPTURE_ARMED && trigger_match(w)) {
+       captrig = TRUE;                  // fired, capture the rest of this command and trigger_post more
+       cappost = trigger_post;
+       capture_state = CAPTURE_ON;
+    }
+    return (TRUE);
+}
+
+//------------------------------------------------------------------------------------------
+// returns the next word from the capture buffer in 'w' and its time in 't' while dumping.
+// returns FALSE, and stops dumping, when there are no more words.
+//------------------------------------------------------------------------------------------
+bit capture_get(unsigned int *w, unsigned long *t) {
+    unsigned int gap;
+    unsigned char c;
+
+    if (cappos >= caplen) {
+       capture_state = CAPTURE_OFF;
+       return (FALSE);
+    }
+    if (!cappos) caplast = capfirst;
+    *w = CAPBYTE(cappos++);
+    c = CAPBYTE(cappos++);
+    if (c & 0x80) *w |= 0x100;
+    gap = c & GAPESCAPE;
+    if (gap == GAPESCAPE) {
+       gap = CAPBYTE(cappos++);
+       gap |= (unsigned int)CAPBYTE(cappos++) << 8;
+    }
+    caplast += (unsigned long)gap << 2;
+    *t = caplast;
+    return (TRUE);
+}
+
+//------------------------------------------------------------------------------------------
+// prints what is in the capture buffer.
+//------------------------------------------------------------------------------------------
+void capture_status(void) {
+    printf("capture %s: %u words, %u of %u bytes%s%s\r\n",
+           capture_state == CAPTURE_ON ? "on" : capture_state == CAPTURE_DUMP ? "dumping" :
+           capture_state == CAPTURE_ARMED ? "armed" : "off",
+           capwords,caplen,CAPSIZE,captrig ? ", triggered" : "",capfull ? ", full" : "");
+}
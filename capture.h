@@ -0,0 +1,17 @@
+// capture.c function prototypes...
+
+#define CAPTURE_OFF  0                  // capture states
+#define CAPTURE_ON   1                  // BUS words go into the capture buffer instead of the console
+#define CAPTURE_DUMP 2                  // the capture buffer is being sent to the console
+#define CAPTURE_ARMED 3                 // BUS words go into the capture buffer until the trigger fires
+
+void capture_init(void);
+bit capture_resume(void);
+void capture_start(void);
+void capture_stop(void);
+void capture_dump(void);
+bit capture_put(unsigned int w, unsigned long t);
+bit capture_get(unsigned int *w, unsigned long *t);
+void capture_status(void);
+
+extern unsigned char xdata capture_state; // one of CAPTURE_xxx
@@ -0,0 +1,61 @@
+// Oscillator frequency and the timer settings worked out from it.
+//
+// FOSC is the only thing to change for a different crystal, e.g. DEFINE(FOSC=6000000)
+// on the C51 command line. The timer 0 tick, the timer 2 microsecond clock, the console
+// baud rates and the watchdog intervals all follow from it at compile time, and the build
+// stops here if the BUS or the console can't be run from it.
+//
+// Serial 1 has to receive the BUS at 187.5 kbps in mode 2, which only divides the clock by
+// 64, or by 32 with SMOD_1 set, so the crystal must be 12 MHz or 6 MHz. Timers 0 and 2
+// count at FOSC/12, one or two microseconds a count.
+
+#ifndef FOSC
+#define FOSC 12000000UL                 // oscillator frequency in Hz
+#endif
+
+#define BUSBAUD 187500UL                // Wheelwriter BUS bit rate
+
+#if FOSC == 64*BUSBAUD
+#define BUS_SMOD 0                      // SMOD_1 for serial 1 mode 2 at FOSC/64...
+#elif FOSC == 32*BUSBAUD
+#define BUS_SMOD 1                      // ...or at FOSC/32
+#else
+#error "serial 1 can't receive the BUS at 187.5 kbps with this FOSC, it must be 12 MHz or 6 MHz"
+#endif
+
+#define TIMER_US (12000000UL/FOSC)      // microseconds per count of timers 0 and 2
+
+#if TIMER_US*FOSC != 12000000UL
+#error "timers 0 and 2 don't count in whole microseconds with this FOSC"
+#endif
+
+// timer 0 interrupts every TICK_MS milliseconds
+#define TICK_MS     50
+#define TICK_COUNTS (TICK_MS*1000UL/TIMER_US)
+
+#if TICK_COUNTS > 65536UL
+#error "the timer 0 tick doesn't fit in 16 bits with this FOSC"
+#endif
+
+// Console baud rates. Timer 1 is clocked at FOSC and serial 0 in mode 1 takes 32 of its
+// overflows per bit, or 16 with SMOD_0 (PCON.7) set, which is used whenever the reload
+// fits since it halves the rounding. A rate is only offered if it comes out within 2%.
+#define BAUD_SMOD(baud)   ((FOSC/16+(baud)/2)/(baud) <= 256)
+#define BAUD_COUNTS(baud) (BAUD_SMOD(baud) ? (FOSC/16+(baud)/2)/(baud) : (FOSC/32+(baud)/2)/(baud))
+#define BAUD_TH1(baud)    (256-BAUD_COUNTS(baud))
+#define BAUD_ACTUAL(baud) (FOSC/(BAUD_SMOD(baud) ? 16 : 32)/BAUD_COUNTS(baud))
+#define BAUD_OK(baud)     (BAUD_COUNTS(baud) <= 256 && BAUD_ACTUAL(baud)*100 >= (baud)*98UL && BAUD_ACTUAL(baud)*100 <= (baud)*102UL)
+
+#if !BAUD_OK(2400) || !BAUD_OK(4800) || !BAUD_OK(9600) || !BAUD_OK(14400) || !BAUD_OK(28800)
+#error "the console can't run at 2400 to 28800 bps with this FOSC"
+#endif
+
+// the console rates, which init_serial0() sets up, "baud" offers and wwmux accepts
+#if BAUD_OK(57600)
+#define BAUDRATES 2400,4800,9600,14400,28800,57600
+#else
+#define BAUDRATES 2400,4800,9600,14400,28800
+#endif
+
+// the watchdog times out after 2^17, 2^20, 2^23 or 2^26 clocks, for init_watchdog() 0 to 3
+#define WATCHDOG_MS(interval) ((1UL<<(17+3*(interval)))/(FOSC/1000))
@@ -0,0 +1,340 @@
+// Command console on serial 0.
+//
+// Characters typed on the console are collected into a line and executed when Enter is
+// pressed, so the reader can be reconfigured without changing the switches. Settings made
+// here override the switches until the reader is reset.
+//
+//   help                           list the commands
+//   mode [ascii|hex|bin|page|stats|switches]  output mode, "switches" = switches 1 and 4 decide
+//   time [on|off|switches]         timestamps in HEX and binary mode, "switches" = switch 2 decides
+//   baud [2400|4800|9600|14400|28800|57600]  console baud rate, 57600 if the crystal allows it
+//   ack [on|off]                   discard the acknowledge words from the Printer Board
+//   pitch [10|12|15]               printwheel pitch for ASCII and page mode
+//   stats [clear|every <seconds>]  print or clear the statistics, or print them periodically
+//   ?                              same as stats
+//   capture [start|stop|dump]      capture BUS words to memory, send them to the console later
+//   trigger [off|pre <n>|post <n>|<word>[/<mask>] ...]  start capturing at a sequence of words, "x" = any word
+//   send <word> ...                send words, in hex, to the Printer Board, e.g. "send 121 003 001 00A"
+//   print                          type the text that follows on the typewriter, up to Ctrl-D
+//
+// With no argument, a command prints its current setting.
+
+#include <stdio.h>
+#include <string.h>
+#include "hal.h"
+#include "clock.h"
+#include "wwproto.h"
+#include "uart12.h"
+#include "reader.h"
+#include "console.h"
+#include "capture.h"
+#include "page.h"
+#include "printer.h"
+#include "trigger.h"
+
+#define CR    0x0D
+#define LF    0x0A
+#define BS    0x08
+#define DEL   0x7F
+
+#define FALSE 0
+#define TRUE  1
+
+#define LINESIZE 32                     // longest command line
+
+static char xdata line[LINESIZE+1];     // the command line being typed
+static unsigned char length;
+
+static unsigned int console_baud;       // the console baud rate
+
+code const unsigned int baudrates[] = {BAUDRATES};   // the rates init_serial0() knows, see clock.h
+const char code * code modenames[] = {"switches","ascii","hex","bin","page","stats"};   // indexed by MODE_xxx
+const char code * code settingnames[] = {"off","on","switches"};        // indexed by SETTING_xxx
+
+//------------------------------------------------------------------------------------------
+// returns the decimal number in 's', or 0xFFFF if 's' isn't a number.
+//------------------------------------------------------------------------------------------
+static unsigned int number(char *s) {
+    unsigned int n = 0;
+
+    if (!*s) return (0xFFFF);
+    while (*s) {
+       if (*s < '0' || *s > '9' || n > 6553) return (0xFFFF);
+       n = n*10 + (*s++ - '0');
+    }
+    return (n);
+}
+
+//------------------------------------------------------------------------------------------
+// returns the hexadecimal BUS word at the start of 's', up to a space or the end, or 0xFFFF
+// if it isn't one.
+//------------------------------------------------------------------------------------------
+static unsigned int hexword(char *s) {
+    unsigned int n = 0;
+
+    if (!*s || *s == ' ') return (0xFFFF);
+    while (*s && *s != ' ') {
+       if (n > 0x1F) return (0xFFFF);
+       if (*s >= '0' && *s <= '9')
+          n = n*16 + (*s - '0');
+       else if (*s >= 'A' && *s <= 'F')
+          n = n*16 + (*s - 'A' + 10);
+       else if (*s >= 'a' && *s <= 'f')
+          n = n*16 + (*s - 'a' + 10);
+       else
+          return (0xFFFF);
+       ++s;
+    }
+    return (n);
+}
+
+//------------------------------------------------------------------------------------------
+// returns the trigger pattern at the start of 's' in 'value' and 'mask': a word, "004", a
+// word and a mask, "080/180", or "x" for any word. returns FALSE if it isn't one.
+//------------------------------------------------------------------------------------------
+static bit pattern(char *s, unsigned int *value, unsigned int *mask) {
+    char *slash;
+
+    if (s[0] == 'x' && (!s[1] || s[1] == ' ')) {
+       *value = 0;
+       *mask = 0;
+       return (TRUE);
+    }
+    for (slash = s; *slash && *slash != ' ' && *slash != '/'; ++slash);
+    if (*slash == '/') {
+       *slash = ' ';                    // hexword() stops at a space
+       *value = hexword(s);
+       *mask = hexword(slash+1);
+       *slash = '/';
+    }
+    else {
+       *value = hexword(s);
+       *mask = 0x1FF;
+    }
+    if (*value > 0x1FF || *mask > 0x1FF) return (FALSE);
+    *value &= *mask;                    // bits outside the mask don't count
+    return (TRUE);
+}
+
+//------------------------------------------------------------------------------------------
+// returns the index of 's' in the list of 'count' names, or 0xFF if it isn't there.
+//------------------------------------------------------------------------------------------
+static unsigned char lookup(char *s, const char code * code *names, unsigned char count) {
+    unsigned char i;
+
+    for (i = 0; i < count; i++) {
+       if (!strcmp(s,names[i])) return (i);
+    }
+    return (0xFF);
+}
+
+//------------------------------------------------------------------------------------------
+// executes the command line.
+//------------------------------------------------------------------------------------------
+static void execute(void) {
+    char *cmd, *arg, *arg2;
+    unsigned char i,pass;
+    unsigned int n,value,mask;
+    bit bad = FALSE;
+
+    cmd = line;
+    while (*cmd == ' ') ++cmd;
+    for (arg = cmd; *arg && *arg != ' '; ++arg);
+    if (*arg) *arg++ = 0;               // split off the first argument...
+    while (*arg == ' ') ++arg;
+    for (arg2 = arg; *arg2 && *arg2 != ' '; ++arg2);
+    if (*arg2) *arg2++ = 0;             // ...and the second
+    while (*arg2 == ' ') ++arg2;
+
+    if (!*cmd) {
+       return;
+    }
+    else if (!strcmp(cmd,"help")) {
+       printf("mode [ascii|hex|bin|page|stats|switches]\r\n");
+       printf("time [on|off|switches]\r\n");
+       printf("baud [");
+       for (i = 0; i < sizeof(baudrates)/sizeof(baudrates[0]); i++)
+          printf(i ? "|%u" : "%u",baudrates[i]);
+       printf("]\r\n");
+       printf("ack [on|off]\r\n");
+       printf("pitch [10|12|15]\r\n");
+       printf("stats [clear|every <seconds>]\r\n");
+       printf("capture [start|stop|dump]\r\n");
+       printf("trigger [off|pre <n>|post <n>|<word>[/<mask>] ...]\r\n");
+       printf("send <word> ...\r\n");
+       printf("print\r\n");
+    }
+    else if (!strcmp(cmd,"mode")) {
+       if (*arg && (i = lookup(arg,modenames,sizeof(modenames)/sizeof(modenames[0]))) != 0xFF) {
+          if (output_mode == MODE_PAGE && i != MODE_PAGE)
+             page_flush();              // send the unfinished line
+          else if (output_mode != MODE_PAGE && i == MODE_PAGE)
+             page_init();               // start at the left margin of a new line
+          n = output_mode;
+          output_mode = i;
+          if (n != MODE_STATS && i == MODE_STATS)
+             clear_summary();           // the first summary covers a whole interval
+       }
+       else if (*arg)
+          bad = TRUE;
+       printf("mode %s\r\n",modenames[output_mode]);
+    }
+    else if (!strcmp(cmd,"time")) {
+       if (*arg && (i = lookup(arg,settingnames,3)) != 0xFF)
+          timestamps = i;
+       else if (*arg)
+          bad = TRUE;
+       printf("time %s\r\n",settingnames[timestamps]);
+    }
+    else if (!strcmp(cmd,"baud")) {
+       if (*arg) {
+          n = number(arg);
+          for (i = 0; i < sizeof(baudrates)/sizeof(baudrates[0]) && baudrates[i] != n; i++);
+          if (i == sizeof(baudrates)/sizeof(baudrates[0]))
+             bad = TRUE;
+          else {
+             printf("baud %u\r\n",n);
+             flush_serial0();           // finish sending at the old rate before changing
+             init_serial0(n);
+             console_baud = n;
+          }
+       }
+       else
+          printf("baud %u\r\n",console_baud);
+    }
+    else if (!strcmp(cmd,"ack")) {
+       if (*arg && (i = lookup(arg,settingnames,2)) != 0xFF)
+          ack_filter = i;
+       else if (*arg)
+          bad = TRUE;
+       printf("ack %s\r\n",settingnames[ack_filter]);
+    }
+    else if (!strcmp(cmd,"pitch")) {
+       if (*arg) {
+          switch (number(arg)) {
+             case 10: microSpacesPerCharacter = TENPITCH; break;
+             case 12: microSpacesPerCharacter = TWELVEPITCH; break;
+             case 15: microSpacesPerCharacter = FIFTEENPITCH; break;
+             default: bad = TRUE;
+          }
+       }
+       printf("pitch %u\r\n",microSpacesPerCharacter == TENPITCH ? 10 : microSpacesPerCharacter == TWELVEPITCH ? 12 : 15);
+    }
+    else if (!strcmp(cmd,"stats") || !strcmp(cmd,"?")) {
+       if (!*arg)
+          print_stats();
+       else if (!strcmp(arg,"clear"))
+          clear_stats();
+       else if (!strcmp(arg,"every") && (n = number(arg2)) <= 255) {
+          stats_seconds = n;
+          printf("stats every %u\r\n",n);
+       }
+       else
+          bad = TRUE;
+    }
+    else if (!strcmp(cmd,"capture")) {
+       if (!strcmp(arg,"start"))
+          capture_start();
+       else if (!strcmp(arg,"stop"))
+          capture_stop();
+       else if (!strcmp(arg,"dump"))
+          capture_dump();               // no status, it would end up in front of the dump
+       else if (*arg)
+          bad = TRUE;
+       if (capture_state != CAPTURE_DUMP)
+          capture_status();
+    }
+    else if (!strcmp(cmd,"send")) {
+       if (*arg2) arg[strlen(arg)] = ' ';  // put the line back together
+       for (pass = 0; pass < 2 && !bad; pass++) {  // check all the words, then send them
+          n = 0;
+          for (arg2 = arg; *arg2; n++) {
+             if (hexword(arg2) > 0x1FF)
+                bad = TRUE;
+             else if (pass)
+                send_WWdata(hexword(arg2));
+             while (*arg2 && *arg2 != ' ') ++arg2;
+             while (*arg2 == ' ') ++arg2;
+          }
+          if (!n)
+             bad = TRUE;
+          else if (!pass && n > tx1_free()) {
+             printf("BUS transmit buffer full\r\n");
+             break;
+          }
+       }
+    }
+    else if (!strcmp(cmd,"trigger")) {
+       if (!strcmp(arg,"off"))
+          trigger_steps = 0;
+       else if (!strcmp(arg,"pre") && (n = number(arg2)) <= 255)
+          trigger_pre = n;
+       else if (!strcmp(arg,"post") && (n = number(arg2)) <= 255)
+          trigger_post = n;
+       else if (*arg) {
+          if (*arg2) arg[strlen(arg)] = ' ';  // put the line back together
+          for (pass = 0; pass < 2 && !bad; pass++) {  // check all the patterns, then set them
+             i = 0;
+             for (arg2 = arg; *arg2; i++) {
+                if (i == TRIGSTEPS || !pattern(arg2,&value,&mask))
+                   bad = TRUE;
+                else if (pass) {
+                   trigger_value[i] = value;
+                   trigger_mask[i] = mask;
+                   trigger_steps = i+1;
+                }
+                while (*arg2 && *arg2 != ' ') ++arg2;
+                while (*arg2 == ' ') ++arg2;
+             }
+          }
+       }
+       if (!bad)
+          trigger_status();
+    }
+    else if (!strcmp(cmd,"print")) {
+       printer_start();
+    }
+    else {
+       printf("unknown command, type help\r\n");
+    }
+
+    if (bad)
+       printf("bad argument, type help\r\n");
+}
+
+//------------------------------------------------------------------------------------------
+// initializes the console. 'baudrate' is the rate serial 0 was initialized to.
+//------------------------------------------------------------------------------------------
+void init_console(unsigned int baudrate) {
+    length = 0;
+    console_baud = baudrate;
+}
+
+//------------------------------------------------------------------------------------------
+// takes any characters typed on the console, echoing them, and executes the command line
+// when Enter is pressed. returns without waiting.
+//------------------------------------------------------------------------------------------
+void poll_console(void) {
+    char c;
+
+    while (char_avail() && !printing) { // the rest is text to type after a "print" command
+       c = getchar();
+       if (c == CR || c == LF) {
+          if (c == LF && !length) continue; // LF after CR
+          printf("\r\n");
+          line[length] = 0;
+          length = 0;
+          execute();
+       }
+       else if (c == BS || c == DEL) {
+          if (length) {
+             --length;
+             printf("\b \b");
+          }
+       }
+       else if (c >= ' ' && length < LINESIZE) {
+          line[length++] = c;
+          putchar(c);
+       }
+    }
+}
@@ -0,0 +1,3 @@
+// console.c function prototypes...
+void init_console(unsigned int baudrate);
+void poll_console(void);
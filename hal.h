@@ -0,0 +1,63 @@
+// Hardware abstraction layer.
+//
+// The firmware is normally compiled by Keil C51 for the DS89C440. When it is compiled
+// by anything else (gcc on Linux) the SFRs, port pins and C51 memory type keywords are
+// replaced by the simulated hardware in host/hal_host.c so that the same parser and
+// ring buffer code can be run natively against a simulated Wheelwriter BUS.
+
+#ifndef HAL_H
+#define HAL_H
+
+#ifdef __C51__
+
+#include <reg420.h>
+
+#define INTERRUPT(vector) interrupt vector
+#define USING(bank)       using bank
+
+// nothing to do on the real hardware. on the host this is where the simulated
+// interrupts are delivered, so it must be called from every busy-wait loop.
+#define hal_poll()
+
+// idle mode: the CPU stops until the next interrupt, the timers and serial ports keep
+// running. on the host there is nothing to wait for, so it delivers the simulated
+// interrupts instead.
+#define hal_idle()        PCON |= 0x01
+
+// marks xdata variables that must keep their contents across a watchdog reset. STARTUP.A51
+// only clears idata (XDATALEN is 0) and the C51 initialization only sets variables that
+// have an initializer, so an xdata variable without one is left as it was.
+#define NOINIT
+
+sbit switch1 = P0^0;                    // dip switch connected to pin 5 (ASCII/HEX mode)
+sbit switch2 = P0^1;                    // dip switch connected to pin 6 (debug mode, timestamps)
+sbit switch3 = P0^2;                    // dip switch connected to pin 7 (add linefeeds)
+sbit switch4 = P0^3;                    // dip switch connected to pin 8 (binary mode)
+
+sbit redLED =   P0^4;                   // red LED connected to pin 35 0=on, 1=off
+sbit amberLED = P0^5;                   // amber LED connected to pin 34 0=on, 1=off
+sbit greenLED = P0^6;                   // green LED connected to pin 33 0=on, 1=off
+
+sbit WWbus = P1^2;		  			    // P1.2, (RXD1, pin 3) used to monitor the Wheelwriter BUS
+
+#else
+
+#include "host/c51.h"
+
+#define INTERRUPT(vector)
+#define USING(bank)
+
+// keep the firmware's console functions from colliding with the C library
+#define putchar ww_putchar
+#define getchar ww_getchar
+#define printf  ww_printf
+#define main    firmware_main
+
+#define hal_idle() hal_poll()
+#define NOINIT                          // the simulation has no resets
+
+#include "host/hal_host.h"
+
+#endif
+
+#endif
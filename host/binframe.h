@@ -0,0 +1,21 @@
+// Binary mode frame lengths, for the host tools that read binary captures. See binout.c
+// for the frame format.
+
+#ifndef BINFRAME_H
+#define BINFRAME_H
+
+#include <stddef.h>
+#include "binout.h"
+
+// returns the length of a binary frame with the given header byte, from the sync byte to
+// the checksum, 0 if it isn't a frame header
+static size_t frame_length(unsigned char header) {
+    unsigned int type = header >> 4, n = header & 0x0F;
+
+    if (n < 1 || n > BINMAXWORDS) return 0;
+    if (type == BINWORDS)   return 2 + (9*n+7)/8 + 1;
+    if (type == BINSTAMPED) return 2 + 4 + (9*n+7)/8 + 2*(n-1) + 1;
+    return 0;
+}
+
+#endif
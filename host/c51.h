@@ -0,0 +1,15 @@
+// C51 keywords for host compilers.
+//
+// The firmware headers use the C51 memory types and bit variables, which have no meaning
+// on the host. Host tools include this before any firmware header.
+
+#ifndef C51_H
+#define C51_H
+
+#define xdata
+#define idata
+#define data
+#define code
+#define bit unsigned char
+
+#endif
@@ -0,0 +1,239 @@
+// Simulated DS89C440 hardware for running the firmware natively on the host. See hal_host.h.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <time.h>
+#include "hal_host.h"
+#include "c51.h"
+#include "capture.h"
+
+#define SBUF0_EMPTY 0x100               // value no 8 bit write can leave in SBUF0
+
+volatile unsigned int  SBUF0;
+volatile unsigned char PCON, SCON0, TMOD, CKMOD, CKCON, PMR, WDCON, TA;
+volatile unsigned char TH0, TL0, TH1, SBUF1;
+volatile unsigned char T2CON, TH2, TL2, RCAP2H, RCAP2L;
+
+volatile unsigned char TI, RI, REN, ES0, TR1;
+volatile unsigned char TI1, RI1, RB81, TB8_1, REN1, ES1, SMOD_1, SM01, SM11, SM21;
+volatile unsigned char EA, ET0, TR0, ET2, TR2, TF2;
+volatile unsigned char POR, WTRF, EWT, RWT;
+
+volatile unsigned char switch1 = 1, switch2 = 1, switch3 = 1, switch4 = 1;  // all switches off
+volatile unsigned char redLED = 1, amberLED = 1, greenLED = 1;
+volatile unsigned char WWbus = 1;       // the BUS idles high
+
+static const unsigned int *bus_words;   // words the simulated BUS will deliver
+static const unsigned long *bus_times;  // and when, NULL to use bus_rate
+static unsigned long bus_start;         // when the first word was delivered
+static unsigned long bus_count;
+static unsigned long bus_next;          // index of the next word to deliver
+static unsigned long bus_rate;          // words per second, 0 = as fast as possible
+static int bus_acks = 1;                // the Printer Board acknowledges the words the firmware sends
+static int ack_due;                     // an acknowledge is on its way
+static unsigned long bus_sent;          // words the firmware sent
+static int bus_list;                    // list the words the firmware sends on stderr
+
+static unsigned long console_baud;      // 0 = characters leave serial 0 instantly
+static FILE *console_out;               // where they go, NULL = stdout
+static const char *console_in;          // characters still to be typed on the console
+static const char *console_end;         // characters to type once the BUS words run out
+static int tx_shifting;                 // a character is in the serial 0 shift register
+static unsigned int tx_char;
+static int tx_flow;                     // and it is XON or XOFF
+static unsigned long tx_done;           // when the character in the shift register is finished
+static unsigned long console_bytes;
+static int console_stopped;             // the firmware has sent XOFF
+
+static unsigned long next_tick;         // when Timer0_ISR() is due next
+static unsigned long t2_high;           // timer 2 overflows so far
+static int in_poll;                     // hal_poll() is not reentrant
+static int idle_polls;                  // hal_poll() calls in a row with nothing left to do
+static struct timespec start;
+
+// ---------------------------------------------------------------------------
+// microseconds since the simulation started
+// ---------------------------------------------------------------------------
+unsigned long hal_micros(void) {
+    struct timespec now;
+
+    if (!start.tv_sec && !start.tv_nsec)
+       clock_gettime(CLOCK_MONOTONIC,&start);
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return (unsigned long)(now.tv_sec-start.tv_sec)*1000000UL + (now.tv_nsec-start.tv_nsec)/1000;
+}
+
+void hal_bus_feed(const unsigned int *words, const unsigned long *times, unsigned long count, unsigned long rate) {
+    bus_words = words;
+    bus_times = times;
+    bus_count = count;
+    bus_next = 0;
+    bus_rate = rate;
+}
+
+void hal_bus_acks(int on) {
+    bus_acks = on;
+}
+
+void hal_bus_list(int on) {
+    bus_list = on;
+}
+
+void hal_console_baud(unsigned long baud) {
+    console_baud = baud;
+}
+
+void hal_console_output(int fd) {
+    if (!(console_out = fdopen(fd,"w"))) {
+       perror("fdopen");
+       exit(1);
+    }
+    setvbuf(console_out,NULL,_IONBF,0);  // each character as it leaves serial 0, ASCII mode seldom ends a line
+}
+
+void hal_console_input(const char *at_start, const char *at_end) {
+    console_in = at_start;
+    console_end = at_end;
+}
+
+// ---------------------------------------------------------------------------
+// the host C library printf() can't reach the firmware's putchar(), so format
+// into a buffer and send that through the serial 0 transmit buffer instead.
+// ---------------------------------------------------------------------------
+int ww_printf(const char *fmt, ...) {
+    char buf[256];
+    va_list ap;
+    int n,i;
+
+    va_start(ap,fmt);
+    n = vsnprintf(buf,sizeof(buf),fmt,ap);
+    va_end(ap);
+    if (n > (int)sizeof(buf)-1) n = sizeof(buf)-1;
+    for (i = 0; i < n; i++)
+       ww_putchar(buf[i]);
+    return n;
+}
+
+// ---------------------------------------------------------------------------
+// serial 0: runs the transmit interrupt and moves characters through the
+// simulated shift register at the console baud rate.
+// ---------------------------------------------------------------------------
+static void serial0_poll(unsigned long now) {
+    do {
+       if (tx_shifting) {
+          if (console_baud && now < tx_done) return;
+          if (tx_flow)
+             console_stopped = tx_char == 0x13; // XOFF or XON, the terminal stops or carries on typing
+          else
+             putc(tx_char,console_out ? console_out : stdout);
+          ++console_bytes;
+          tx_shifting = 0;
+          TI = 1;                       // transmit finished
+       }
+       if (!TI || !ES0 || !EA) return;
+       SBUF0 = SBUF0_EMPTY;
+       tx_flow = rx0_xchar != 0;        // so binary output that happens to hold 0x11 or 0x13 isn't taken for XON or XOFF
+       serial0_isr();
+       if (SBUF0 == SBUF0_EMPTY) return; // the interrupt had nothing more to send
+       tx_char = SBUF0 & 0xFF;
+       tx_shifting = 1;
+       tx_done = now + (console_baud ? 10000000UL/console_baud : 0);
+    } while (!console_baud);
+}
+
+// ---------------------------------------------------------------------------
+// serial 1: sends the word the firmware has written to SBUF1, which it does with
+// reception turned off, and delivers the acknowledge for it and the words that are due
+// from the simulated BUS.
+// ---------------------------------------------------------------------------
+static void serial1_poll(unsigned long now) {
+    unsigned long due = bus_next+1;     // as fast as possible means one word per poll
+    unsigned int w;
+
+    if (!REN1 && SM01 && ES1 && EA) {   // a word is going out
+       ++bus_sent;
+       if (bus_list)
+          fprintf(stderr,"sent 0x%03X\n",(TB8_1 ? 0x100 : 0)|SBUF1);
+       ack_due = bus_acks;
+       TI1 = 1;                         // sent
+       serial1_isr();
+    }
+    if (ack_due && REN1 && ES1 && EA) { // the acknowledge is all zeros
+       ack_due = 0;
+       SBUF1 = 0;
+       RB81 = 0;
+       RI1 = 1;
+       serial1_isr();
+       return;
+    }
+
+    if (bus_times) {                    // replay at the recorded times
+       if (!bus_next) bus_start = now;
+       due = bus_next;
+       while (due < bus_count && bus_times[due]-bus_times[0] <= now-bus_start)
+          ++due;
+    }
+    else if (bus_rate)
+       due = (unsigned long)((unsigned long long)now * bus_rate / 1000000UL);
+    if (due > bus_count) due = bus_count;
+    while (bus_next < due && REN1 && ES1 && EA) {
+       w = bus_words[bus_next++];
+       SBUF1 = w & 0xFF;
+       RB81 = (w & 0x100) != 0;
+       RI1 = 1;
+       serial1_isr();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// delivers any simulated interrupts that are due. when the BUS has no more words
+// and the firmware has consumed and sent everything, the simulation is over.
+// ---------------------------------------------------------------------------
+void hal_poll(void) {
+    unsigned long now;
+
+    if (in_poll) return;
+    in_poll = 1;
+    now = hal_micros();
+
+    if (TR2) {                          // timer 2 counts microseconds
+       if ((now >> 16) != t2_high) {
+          TF2 = 1;
+          t2_high = now >> 16;
+       }
+       TH2 = now >> 8;
+       TL2 = now;
+       if (TF2 && ET2 && EA)
+          Timer2_ISR();
+    }
+    if (TR0 && ET0 && EA && now >= next_tick) {
+       next_tick = now + 50000;         // timer 0 interrupts every 50 milliseconds
+       Timer0_ISR();
+    }
+    serial1_poll(now);
+    serial0_poll(now);
+    if (console_in && *console_in && !console_stopped && !TI && REN && ES0 && EA) {
+       SBUF0 = (unsigned char)*console_in++;    // type one character on the console
+       RI = 1;
+       serial0_isr();
+    }
+
+    if (bus_next == bus_count && !WWframe_avail() && !rx1_open && !char_avail() && !tx0_count() && !tx_shifting &&
+        capture_state != CAPTURE_DUMP && !tx1_count())
+       ++idle_polls;
+    else
+       idle_polls = 0;
+    if (idle_polls > 2 && console_end) { // the BUS is done, now type the closing console input
+       console_in = console_end;
+       console_end = NULL;
+       idle_polls = 0;
+    }
+    if (idle_polls > 2 && !(console_in && *console_in)) { // give the main loop a pass with nothing to do before stopping
+       fflush(console_out ? console_out : stdout);
+       fprintf(stderr,"%lu BUS words in %.3f s (%.0f words/s), %lu console bytes, %lu BUS words sent\n",
+               bus_count,now/1e6,now ? bus_count*1e6/now : 0.0,console_bytes,bus_sent);
+       exit(0);
+    }
+    in_poll = 0;
+}
@@ -0,0 +1,68 @@
+// Simulated DS89C440 hardware for running the firmware natively on the host.
+//
+// Every SFR and port pin the firmware uses is an ordinary variable here. hal_poll() plays
+// the part of the interrupt controller: it feeds words from the simulated Wheelwriter BUS
+// into serial1_isr() and acknowledges the words the firmware sends, shifts console
+// characters out of serial 0 at the selected baud rate, runs Timer0_ISR() every 50
+// milliseconds and keeps timer 2 counting microseconds.
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+// special function registers
+extern volatile unsigned int  SBUF0;    // wider than the real register so hal_poll() can tell when it is written
+extern volatile unsigned char PCON, SCON0, TMOD, CKMOD, CKCON, PMR, WDCON, TA;
+extern volatile unsigned char TH0, TL0, TH1, SBUF1;
+extern volatile unsigned char T2CON, TH2, TL2, RCAP2H, RCAP2L;
+
+// SFR bits
+extern volatile unsigned char TI, RI, REN, ES0, TR1;
+extern volatile unsigned char TI1, RI1, RB81, TB8_1, REN1, ES1, SMOD_1, SM01, SM11, SM21;
+extern volatile unsigned char EA, ET0, TR0, ET2, TR2, TF2;
+extern volatile unsigned char POR, WTRF, EWT, RWT;
+
+// port pins
+extern volatile unsigned char switch1, switch2, switch3, switch4;
+extern volatile unsigned char redLED, amberLED, greenLED;
+extern volatile unsigned char WWbus;
+
+// delivers any simulated interrupts that are due
+void hal_poll(void);
+
+// selects the words the simulated BUS will deliver, in words per second (0 = as fast as
+// the firmware will take them) or, if 'times' isn't NULL, at the recorded times in
+// microseconds, and the console baud rate (0 = no limit)
+void hal_bus_feed(const unsigned int *words, const unsigned long *times, unsigned long count, unsigned long rate);
+void hal_console_baud(unsigned long baud);
+
+// sends the console output to file descriptor 'fd' instead of stdout
+void hal_console_output(int fd);
+
+// selects whether the simulated Printer Board acknowledges the words the firmware sends,
+// and whether they are listed on stderr
+void hal_bus_acks(int on);
+void hal_bus_list(int on);
+
+// selects the characters typed on the console when the simulation starts and once the
+// BUS words run out, either may be NULL
+void hal_console_input(const char *at_start, const char *at_end);
+
+// microseconds since the simulation started, which also drives timer 2
+unsigned long hal_micros(void);
+
+// the firmware entry points hal_poll() calls
+void firmware_main(void);
+void serial0_isr(void);
+void serial1_isr(void);
+void Timer0_ISR(void);
+void Timer2_ISR(void);
+char WWframe_avail(void);
+char char_avail(void);
+unsigned char tx0_count(void);
+unsigned char tx1_count(void);
+char ww_putchar(char c);
+int  ww_printf(const char *fmt, ...);
+extern volatile unsigned char rx1_open;    // serial1_isr() has a frame that isn't finished
+extern volatile unsigned char rx0_xchar;   // serial0_isr() sends this XON or XOFF next
+
+#endif
@@ -0,0 +1,86 @@
+// Binary capture decoder.
+//
+// Turns the frames sent by the reader in binary mode (see binout.c) back into the same
+// listing HEX mode produces, with the arrival times if the frames have them. Anything
+// between frames, such as the sign-on message, is skipped, and a frame with a bad
+// checksum is dropped and counted.
+//
+// build:  gcc -O2 -I. -o wwbindec host/wwbindec.c
+//
+// usage:  wwbindec [capture.bin]     reads stdin if no file is given
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "c51.h"
+#include "binframe.h"
+
+// prints the words in the frame at 'p', which has been checked
+static unsigned int print_frame(const unsigned char *p) {
+    unsigned int n = p[1] & 0x0F, stamped = (p[1] >> 4) == BINSTAMPED;
+    unsigned int bits = 0, nbits = 0, w, i;
+    const unsigned char *packed = p + (stamped ? 6 : 2);
+    const unsigned char *gaps = packed + (9*n+7)/8;
+    unsigned long t = 0;
+
+    if (stamped)
+       t = p[2] | (unsigned long)p[3]<<8 | (unsigned long)p[4]<<16 | (unsigned long)p[5]<<24;
+    for (i = 0; i < n; i++) {
+       while (nbits < 9) {
+          bits |= (unsigned int)*packed++ << nbits;
+          nbits += 8;
+       }
+       w = bits & 0x1FF;
+       bits >>= 9;
+       nbits -= 9;
+       if (w == 0x121) printf("\n");    // same layout as HEX mode
+       if (stamped) {
+          if (i) {
+             t = (t + (gaps[0] | gaps[1]<<8)) & 0xFFFFFFFFUL;
+             gaps += 2;
+          }
+          printf("0x%03X %lu\n",w,t);
+       }
+       else
+          printf("0x%03X\n",w);
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *f = stdin;
+    unsigned char *buf = NULL, sum;
+    size_t size = 0, len = 0, pos, n, i;
+    unsigned long words = 0, frames = 0, bad = 0, skipped = 0;
+
+    if (argc > 1 && !(f = fopen(argv[1],"rb"))) {
+       perror(argv[1]);
+       return 1;
+    }
+    do {                                // read the whole capture
+       if (len == size && !(buf = realloc(buf,size = size ? size*2 : 65536))) {
+          perror("realloc");
+          return 1;
+       }
+       len += fread(buf+len,1,size-len,f);
+    } while (!feof(f) && !ferror(f));
+
+    for (pos = 0; pos < len; ) {
+       if (buf[pos] != BINSYNC || pos+1 >= len || !(n = frame_length(buf[pos+1])) || pos+n > len) {
+          ++pos;                        // not the start of a frame
+          ++skipped;
+          continue;
+       }
+       for (sum = 0, i = 1; i < n; i++)
+          sum += buf[pos+i];
+       if (sum) {
+          ++bad;                        // resynchronize just past this sync byte
+          ++pos;
+          continue;
+       }
+       words += print_frame(buf+pos);
+       ++frames;
+       pos += n;
+    }
+    fprintf(stderr,"%lu words in %lu frames, %lu bad frames, %lu bytes skipped\n",words,frames,bad,skipped);
+    return 0;
+}
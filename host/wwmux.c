@@ -0,0 +1,549 @@
+// Reader multiplexer.
+//
+// Follows the consoles of any number of readers, each on its own serial port, from one
+// epoll loop, and writes every line they send with the local time it started and the
+// reader's name in front, either all to one combined stream on stdout or each reader to
+// its own file. HEX mode lines are recognized and counted as BUS words and, with -a, are
+// decoded by the reader's own ww_decode() into the text ASCII mode would have sent, which
+// takes their place. Everything else, ASCII mode text, console replies and statistics, is
+// passed on as it is. Binary mode output isn't understood, use wwbindec for that.
+//
+// The memory used is fixed. A line longer than LINESIZE is split, and each output has a
+// queue of -q bytes. A line that doesn't fit in the queue, because stdout is being read
+// more slowly than the readers send, is dropped and counted, so a slow output never holds
+// up reading the ports. A port that closes or fails, a reader unplugged or a wwsim that
+// has finished, is opened again every second.
+//
+// Every -i seconds a report goes to stderr with, for each port, the bytes, lines and BUS
+// words per second since the report before, the bytes waiting in the kernel to be read
+// from the port, the bytes waiting in its output queue and the lines dropped. The last
+// report, when wwmux exits, covers the whole run.
+//
+// build:  gcc -O2 -Wall -I. -o wwmux host/wwmux.c wwproto.c
+//
+// usage:  wwmux [-b baud] [-o dir] [-a] [-p pitch] [-i seconds] [-q bytes] [-1] port[=name] ...
+//         -b baud     serial port baud rate, one the reader's "baud" offers (BAUDRATES in
+//                     clock.h), the default is 9600
+//         -o dir      write each reader to dir/name.log, the default is one stream on stdout
+//         -a          replace HEX mode BUS words with the text they type
+//         -p pitch    10, 12 (the default) or 15, for telling spaces from tabs with -a
+//         -i seconds  seconds between reports, 0 = none, the default is 10
+//         -q bytes    size of each output queue, which may end in K or M, the default is 64K
+//         -1          exit once every port has been open and closed again, instead of reopening
+//         name        the reader's name in the output, the default is the port's file name
+//
+// e.g. two simulated readers, see wwsim -p:
+//         wwsim -x -t -b 9600 -p /tmp/ww0 capture.txt &
+//         wwsim -t -b 9600 -p /tmp/ww1 capture.txt &
+//         wwmux -a -1 -i 1 /tmp/ww0 /tmp/ww1
+
+#define _GNU_SOURCE                     // asprintf()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <asm/termbits.h>              // termios2 and BOTHER, for 14400 and 28800, which have no Bxxx
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/ioctl.h>
+#include "c51.h"
+#include "clock.h"
+#include "wwproto.h"
+#include "reader.h"
+
+#undef data                             // c51.h's, which would empty struct epoll_event's 'data'
+
+#define MAXPORTS  256
+#define LINESIZE  256                   // longest line kept, longer ones are split
+#define MAXEVENTS 64
+
+// epoll event tags: a port's index, or one of these
+#define EV_SINK   0x10000               // plus the index of the port the output belongs to, MAXPORTS = stdout
+#define EV_TIMER  0x20000
+#define EV_SIGNAL 0x20001
+
+// an output and the lines waiting to be written to it
+typedef struct {
+    const char *name;
+    int fd;
+    uint32_t tag;                       // its epoll event tag
+    int pollable;                       // in the epoll set, so it can say when it will take more
+    int polled;                         // waiting to be told
+    char *buf;                          // the queue, a ring of 'size' bytes from 'head'
+    size_t size, head, len;
+} sink;
+
+typedef struct {
+    const char *path, *name;
+    int fd;                             // -1 while closed
+    int opened;                         // has been open at least once
+    int failed;                         // the last open failed, so it isn't reported every second
+    sink file;                          // with -o
+    sink *out;                          // 'file' or the combined stream
+
+    char line[LINESIZE];                // the line being received
+    size_t len;
+    int started;
+    struct timespec stamp;              // when it started
+    int after_cr;                       // the byte before was CR, so an LF now ends nothing
+    int after_word;                     // the line before was a BUS word
+
+    ww_decoder decoder;                 // with -a
+    char text[LINESIZE];                // the text typed by the words so far
+    size_t textlen;
+    struct timespec textstamp;          // when its first word came
+
+    unsigned long long bytes, lines, words, dropped;
+    unsigned long long last_bytes, last_lines, last_words;     // at the report before
+} port;
+
+static port ports[MAXPORTS];
+static int nports;
+static sink combined;
+static int ep;                          // the epoll instance
+static int decode;                      // -a
+static unsigned int pitch = TWELVEPITCH;
+static int once;                        // -1
+static int stdout_flags = -1;           // to put back at exit
+static struct timespec started, last_report;
+
+static double seconds_since(const struct timespec *t) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC,&now);
+    return (now.tv_sec - t->tv_sec) + (now.tv_nsec - t->tv_nsec)/1e9;
+}
+
+// ---------------------------------------------------------------------------
+// outputs
+// ---------------------------------------------------------------------------
+static void sink_open(sink *s, const char *name, int fd, size_t size, uint32_t tag) {
+    struct epoll_event ev;
+
+    s->name = name;
+    s->fd = fd;
+    s->size = size;
+    s->tag = tag;
+    if (!(s->buf = malloc(size))) {
+       perror("malloc");
+       exit(1);
+    }
+    ev.events = 0;                      // nothing until there is something to wait for
+    ev.data.u32 = tag;
+    s->pollable = !epoll_ctl(ep,EPOLL_CTL_ADD,fd,&ev);  // a regular file can't be, and never needs to wait
+    if (s->pollable && fd == STDOUT_FILENO) {
+       stdout_flags = fcntl(fd,F_GETFL);
+       fcntl(fd,F_SETFL,stdout_flags|O_NONBLOCK);
+    }
+}
+
+// writes as much of the queue as the output will take without waiting
+static void sink_flush(sink *s) {
+    struct epoll_event ev;
+    ssize_t n;
+    size_t chunk;
+    int want;
+
+    while (s->len) {
+       chunk = s->head + s->len > s->size ? s->size - s->head : s->len;
+       if ((n = write(s->fd,s->buf+s->head,chunk)) < 0) {
+          if (errno == EINTR) continue;
+          if (errno == EAGAIN) break;
+          perror(s->name);
+          exit(1);
+       }
+       s->head = (s->head + n) % s->size;
+       s->len -= n;
+    }
+    want = s->len != 0;
+    if (s->pollable && want != s->polled) {
+       ev.events = want ? EPOLLOUT : 0;
+       ev.data.u32 = s->tag;
+       epoll_ctl(ep,EPOLL_CTL_MOD,s->fd,&ev);
+       s->polled = want;
+    }
+}
+
+// adds 'n' bytes to the queue, returns 0 if there isn't room for them
+static int sink_put(sink *s, const char *bytes, size_t n) {
+    size_t tail, first;
+
+    if (s->len + n > s->size) return 0;
+    tail = (s->head + s->len) % s->size;
+    first = n < s->size - tail ? n : s->size - tail;
+    memcpy(s->buf+tail,bytes,first);
+    memcpy(s->buf,bytes+first,n-first);
+    s->len += n;
+    return 1;
+}
+
+// queues a line from port 'p' that started at 'when'
+static void emit(port *p, const char *text, size_t len, const struct timespec *when) {
+    char out[LINESIZE+128];
+    struct tm tm;
+    size_t n;
+
+    localtime_r(&when->tv_sec,&tm);
+    n = strftime(out,sizeof(out),"%Y-%m-%d %H:%M:%S",&tm);
+    n += snprintf(out+n,sizeof(out)-n,".%03ld %s ",when->tv_nsec/1000000,p->name);
+    if (n > sizeof(out)-1) n = sizeof(out)-1;
+    if (len > sizeof(out)-1-n) len = sizeof(out)-1-n;
+    memcpy(out+n,text,len);
+    n += len;
+    out[n++] = '\n';
+    if (!sink_put(p->out,out,n))
+       ++p->dropped;
+}
+
+// ---------------------------------------------------------------------------
+// decoding
+// ---------------------------------------------------------------------------
+static void text_done(port *p) {
+    emit(p,p->text,p->textlen,&p->textstamp);
+    p->textlen = 0;
+}
+
+static void put(port *p, char c) {
+    if (c == '\n') {
+       text_done(p);
+       return;
+    }
+    if (!p->textlen) p->textstamp = p->stamp;
+    p->text[p->textlen++] = c;
+    if (p->textlen == LINESIZE) text_done(p);
+}
+
+// types the command just completed by ww_decode() the way ASCII mode does, with a newline
+// for the end of a line
+static void type(port *p) {
+    char typed[2];
+    unsigned char i, n = ww_type(&p->decoder,pitch,typed);
+
+    for (i = 0; i < n; i++)
+       put(p,typed[i] == '\r' ? '\n' : typed[i]);
+}
+
+// returns TRUE if the line is a BUS word from HEX mode, "0x121" or "0x121 12345678" with
+// the debug mode timestamp, and leaves the word in 'w'
+static int hex_word(const char *s, size_t len, unsigned int *w) {
+    const char *end = s+len;
+    int digits;
+
+    if (len < 3 || s[0] != '0' || (s[1] != 'x' && s[1] != 'X')) return 0;
+    for (s += 2, *w = 0, digits = 0; s < end; s++, digits++) {
+       if (*s >= '0' && *s <= '9')      *w = *w*16 + (*s - '0');
+       else if (*s >= 'A' && *s <= 'F') *w = *w*16 + (*s - 'A' + 10);
+       else if (*s >= 'a' && *s <= 'f') *w = *w*16 + (*s - 'a' + 10);
+       else break;
+    }
+    if (!digits || digits > 3) return 0;
+    while (s < end && *s == ' ') ++s;
+    while (s < end && *s >= '0' && *s <= '9') ++s;
+    return s == end;
+}
+
+static void line_done(port *p) {
+    unsigned int w;
+    int word = hex_word(p->line,p->len,&w);
+
+    ++p->lines;
+    if (word) ++p->words;
+    if (decode && word) {
+       if (ww_decode(&p->decoder,w & 0x1FF))
+          type(p);
+    }
+    else if (!(decode && !p->len && p->after_word))     // HEX mode puts a blank line before each command
+       emit(p,p->line,p->len,&p->stamp);
+    p->after_word = word;
+    p->len = 0;
+    p->started = 0;
+}
+
+// lines end in CR, LF or CR LF: ASCII mode ends them with CR, or CR LF with switch 3 on,
+// and HEX mode with LF
+static void port_byte(port *p, char c, const struct timespec *now) {
+    int after_cr = p->after_cr;
+
+    p->after_cr = c == '\r';
+    if (c == '\n' && after_cr) return;
+    if (!p->started) {
+       p->stamp = *now;
+       p->started = 1;
+    }
+    if (c == '\n' || c == '\r')
+       line_done(p);
+    else {
+       p->line[p->len++] = c;
+       if (p->len == LINESIZE) line_done(p);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ports
+// ---------------------------------------------------------------------------
+static const unsigned long baudrates[] = {BAUDRATES};  // the same rates as the reader's "baud"
+
+static int baud_ok(unsigned long baud) {
+    size_t i;
+
+    for (i = 0; i < sizeof(baudrates)/sizeof(baudrates[0]); i++)
+       if (baudrates[i] == baud) return 1;
+    return 0;
+}
+
+// opens the port raw at 'baud'. the rate is set with BOTHER, which takes any rate, since
+// 14400 and 28800 aren't among the standard Bxxx speeds
+static void port_open(port *p, unsigned long baud) {
+    struct termios2 t;
+    struct epoll_event ev;
+
+    if ((p->fd = open(p->path,O_RDONLY|O_NOCTTY|O_NONBLOCK)) < 0) {
+       if (!p->failed)
+          fprintf(stderr,"%s: %s: %s\n",p->name,p->path,strerror(errno));
+       p->failed = 1;
+       return;
+    }
+    if (isatty(p->fd) && !ioctl(p->fd,TCGETS2,&t)) {
+       t.c_iflag &= ~(IGNBRK|BRKINT|PARMRK|ISTRIP|INLCR|IGNCR|ICRNL|IXON);   // as cfmakeraw()
+       t.c_oflag &= ~OPOST;
+       t.c_lflag &= ~(ECHO|ECHONL|ICANON|ISIG|IEXTEN);
+       t.c_cflag &= ~(CSIZE|PARENB|CBAUD|(CBAUD<<IBSHIFT));
+       t.c_cflag |= CS8|CLOCAL|CREAD|BOTHER;
+       t.c_cc[VMIN] = 1;
+       t.c_cc[VTIME] = 0;
+       t.c_ispeed = t.c_ospeed = baud;
+       ioctl(p->fd,TCSETS2,&t);
+    }
+    ev.events = EPOLLIN;
+    ev.data.u32 = p - ports;
+    if (epoll_ctl(ep,EPOLL_CTL_ADD,p->fd,&ev)) {
+       perror("epoll_ctl");
+       exit(1);
+    }
+    ww_decode_init(&p->decoder);
+    p->after_word = 0;
+    p->opened = 1;
+    p->failed = 0;
+    fprintf(stderr,"%s: %s open\n",p->name,p->path);
+}
+
+static void port_close(port *p, const char *why) {
+    if (p->started) line_done(p);       // finish what came before it closed
+    if (p->textlen) text_done(p);
+    epoll_ctl(ep,EPOLL_CTL_DEL,p->fd,NULL);
+    close(p->fd);
+    p->fd = -1;
+    fprintf(stderr,"%s: %s closed, %s\n",p->name,p->path,why);
+}
+
+// reads what the port has, once per event so that a busy port can't keep the others waiting
+static void port_read(port *p) {
+    char buf[4096];
+    struct timespec now;
+    ssize_t n, i;
+
+    if ((n = read(p->fd,buf,sizeof(buf))) > 0) {
+       clock_gettime(CLOCK_REALTIME,&now);
+       p->bytes += n;
+       for (i = 0; i < n; i++)
+          port_byte(p,buf[i],&now);
+    }
+    else if (!n)
+       port_close(p,"end of file");
+    else if (errno != EAGAIN && errno != EINTR)
+       port_close(p,strerror(errno));   // EIO when a pseudo-terminal's other end goes away
+}
+
+// ---------------------------------------------------------------------------
+// reports
+// ---------------------------------------------------------------------------
+static void report(int whole_run) {
+    double seconds = seconds_since(whole_run ? &started : &last_report);
+    port *p;
+    int unread, i;
+
+    if (seconds <= 0) seconds = 1;
+    clock_gettime(CLOCK_MONOTONIC,&last_report);
+    fprintf(stderr,"%s %.1f s\n%-12s %9s %8s %8s %8s %8s %8s\n",whole_run ? "total" : "last",seconds,
+            "port","bytes/s","lines/s","words/s","unread","queued","dropped");
+    for (i = 0; i < nports; i++) {
+       p = &ports[i];
+       if (p->fd < 0 || ioctl(p->fd,FIONREAD,&unread)) unread = 0;
+       if (whole_run)
+          p->last_bytes = p->last_lines = p->last_words = 0;
+       fprintf(stderr,"%-12s %9.0f %8.1f %8.0f %8d %8zu %8llu%s\n",p->name,
+               (p->bytes - p->last_bytes)/seconds,(p->lines - p->last_lines)/seconds,
+               (p->words - p->last_words)/seconds,unread,p->out->len,p->dropped,p->fd < 0 ? "  closed" : "");
+       p->last_bytes = p->bytes;
+       p->last_lines = p->lines;
+       p->last_words = p->words;
+    }
+}
+
+// writes out the queues, waiting if need be, and leaves stdout the way it was found
+static void finish(void) {
+    int i;
+
+    for (i = 0; i < nports; i++)
+       if (ports[i].fd >= 0) port_close(&ports[i],"exiting");
+    if (stdout_flags >= 0) fcntl(STDOUT_FILENO,F_SETFL,stdout_flags);
+    combined.pollable = 0;
+    sink_flush(&combined);
+    for (i = 0; i < nports; i++) {
+       ports[i].file.pollable = 0;
+       sink_flush(&ports[i].file);
+    }
+    report(1);
+}
+
+// ---------------------------------------------------------------------------
+
+static size_t parse_size(const char *s) {
+    char *end;
+    size_t n = strtoul(s,&end,0);
+
+    if (*end == 'k' || *end == 'K') n *= 1024;
+    if (*end == 'm' || *end == 'M') n *= 1024*1024;
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    struct epoll_event events[MAXEVENTS], ev;
+    struct itimerspec second = {{1,0},{1,0}};
+    struct signalfd_siginfo si;
+    unsigned long long expirations;
+    unsigned long baud = 9600;
+    unsigned int interval = 10, ticks = 0;
+    size_t queue = 65536;
+    const char *dir = NULL;
+    char *path, *name;
+    sigset_t signals;
+    int c, n, i, fd, timer, sig, done;
+    uint32_t tag;
+    port *p;
+
+    while ((c = getopt(argc,argv,"b:o:ap:i:q:1")) != -1) {
+       switch (c) {
+          case 'b': baud = strtoul(optarg,NULL,0); break;
+          case 'o': dir = optarg; break;
+          case 'a': decode = 1; break;
+          case 'p': pitch = atoi(optarg) == 10 ? TENPITCH : atoi(optarg) == 15 ? FIFTEENPITCH : TWELVEPITCH; break;
+          case 'i': interval = atoi(optarg); break;
+          case 'q': queue = parse_size(optarg); break;
+          case '1': once = 1; break;
+          default:
+             fprintf(stderr,"usage: %s [-b baud] [-o dir] [-a] [-p pitch] [-i seconds] [-q bytes] [-1] port[=name] ...\n",argv[0]);
+             return 1;
+       }
+    }
+    if (optind >= argc) {
+       fprintf(stderr,"%s: no ports\n",argv[0]);
+       return 1;
+    }
+    if (argc - optind > MAXPORTS) {
+       fprintf(stderr,"%s: at most %d ports\n",argv[0],MAXPORTS);
+       return 1;
+    }
+    if (!baud_ok(baud)) {
+       fprintf(stderr,"%s: %lu baud isn't one the reader offers\n",argv[0],baud);
+       return 1;
+    }
+    if (queue < LINESIZE+128) queue = LINESIZE+128;     // room for the longest line at least
+
+    if ((ep = epoll_create1(0)) < 0) {
+       perror("epoll_create1");
+       return 1;
+    }
+    signal(SIGPIPE,SIG_IGN);            // a closed stdout shows up as EPIPE instead
+    sigemptyset(&signals);
+    sigaddset(&signals,SIGINT);
+    sigaddset(&signals,SIGTERM);
+    sigprocmask(SIG_BLOCK,&signals,NULL);
+    if ((sig = signalfd(-1,&signals,SFD_NONBLOCK)) < 0 || (timer = timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK)) < 0 ||
+        timerfd_settime(timer,0,&second,NULL)) {
+       perror("signalfd/timerfd");
+       return 1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u32 = EV_SIGNAL;
+    epoll_ctl(ep,EPOLL_CTL_ADD,sig,&ev);
+    ev.data.u32 = EV_TIMER;
+    epoll_ctl(ep,EPOLL_CTL_ADD,timer,&ev);
+    if (!dir)
+       sink_open(&combined,"stdout",STDOUT_FILENO,queue,EV_SINK+MAXPORTS);
+
+    for (i = optind; i < argc; i++) {
+       p = &ports[nports];
+       path = argv[i];
+       if ((name = strchr(path,'=')) != NULL)
+          *name++ = 0;
+       else
+          name = strrchr(path,'/') ? strrchr(path,'/')+1 : path;
+       p->path = path;
+       p->name = name;
+       p->fd = -1;
+       if (dir) {
+          if (asprintf(&path,"%s/%s.log",dir,name) < 0 || (fd = open(path,O_WRONLY|O_CREAT|O_APPEND,0644)) < 0) {
+             perror(path);
+             return 1;
+          }
+          sink_open(&p->file,path,fd,queue,EV_SINK+nports);
+          p->out = &p->file;
+       }
+       else
+          p->out = &combined;
+       ++nports;
+    }
+    clock_gettime(CLOCK_MONOTONIC,&started);
+    last_report = started;
+    for (i = 0; i < nports; i++)
+       port_open(&ports[i],baud);
+
+    for (;;) {
+       if ((n = epoll_wait(ep,events,MAXEVENTS,-1)) < 0) {
+          if (errno == EINTR) continue;
+          perror("epoll_wait");
+          return 1;
+       }
+       for (i = 0; i < n; i++) {
+          tag = events[i].data.u32;
+          if (tag < MAXPORTS) {
+             if (ports[tag].fd >= 0) port_read(&ports[tag]);    // may have been closed earlier in this batch
+          }
+          else if (tag == EV_SIGNAL) {
+             if (read(sig,&si,sizeof(si)) == sizeof(si)) {
+                finish();
+                return 0;
+             }
+          }
+          else if (tag == EV_TIMER) {
+             if (read(timer,&expirations,sizeof(expirations)) != sizeof(expirations)) continue;
+             ticks += expirations;
+             for (fd = 0, done = 1; fd < nports; fd++) {
+                p = &ports[fd];
+                if (p->fd < 0 && !(once && p->opened))
+                   port_open(p,baud);
+                if (p->fd >= 0 || !p->opened || p->out->len) done = 0;
+             }
+             if (once && done) {
+                finish();
+                return 0;
+             }
+             if (interval && ticks >= interval) {
+                ticks = 0;
+                report(0);
+             }
+          }
+          // EV_SINK: the output will take more, which the flush below sees to
+       }
+       if (combined.len) sink_flush(&combined);
+       for (i = 0; i < nports; i++)
+          if (ports[i].file.len) sink_flush(&ports[i].file);
+    }
+}
@@ -0,0 +1,554 @@
+// Capture analyzer.
+//
+// Decodes long captures from the reader, either the HEX mode listing, with or without the
+// debug mode timestamps, or binary mode output (see binout.c), using the same command
+// table and decoder, wwbus.def and ww_decode(), as the reader itself. The typed text goes
+// to stdout the way ASCII mode would have sent it, except that the end of a line is a
+// newline. A report goes to stderr: how many of each command there were and, if the
+// capture has timestamps, how long each kind of command took on the BUS and how the gaps
+// between BUS words were spread.
+//
+// The capture is memory-mapped and cut into one piece per thread. A piece begins at the
+// first line, or in a binary capture the first frame, after its share of the file, and
+// its first command is at its first 0x121. The words before that are decoded by the piece
+// before, which carries on past the end of its share to there, so the results are the
+// same for any number of threads. In a binary capture a piece starts at a frame only if
+// the frame after it checks out too, so that a run of bytes that happens to look like a
+// frame doesn't throw the piece out.
+//
+// build:  gcc -O2 -pthread -I. -o wwscan host/wwscan.c wwproto.c
+//
+// usage:  wwscan [-j threads] [-p pitch] [-q] capture
+//         -j threads  number of threads, the default is one per processor
+//         -p pitch    10, 12 (the default) or 15, for telling spaces from tabs
+//         -q          only the report, not the text
+//
+//         wwscan -g size capture
+//         writes a synthetic HEX capture with timestamps of about 'size' bytes, which may
+//         end in K, M or G, to be used with -b
+//
+//         wwscan -b [-j threads] capture
+//         times decoding the capture with 1, 2, 4... threads up to -j, without the output
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "c51.h"
+#include "wwproto.h"
+#include "binframe.h"
+#include "reader.h"
+
+#define MAXTHREADS 256
+#define GAPBUCKETS 33                   // gaps of 0, 1, 2-3, 4-7 ... microseconds
+#define BARWIDTH   40                   // characters in the longest histogram bar
+
+typedef struct {
+    unsigned long long count;           // commands timed
+    unsigned long long total;           // microseconds from each 0x121 to the command's last word
+    unsigned long min,max;
+} timing;
+
+// one thread's piece of the capture and what it found there
+typedef struct {
+    const unsigned char *base;          // the whole capture
+    const unsigned char *start;         // the piece's share of it
+    const unsigned char *end;
+    const unsigned char *limit;         // end of the capture, the piece may finish past 'end'
+    int binary;
+    unsigned int pitch;                 // microspaces per character
+    int text_wanted;
+
+    unsigned long long words;           // BUS words decoded
+    unsigned long long stamped;         // of those, with a timestamp
+    unsigned long long frames;          // binary frames
+    unsigned long long bad;             // binary frames with a bad checksum
+    unsigned long long skipped;         // bytes that weren't BUS words, frames or blank lines
+    unsigned long long cmds[WWCMDS+1];
+    timing time[WWCMDS+1];
+    unsigned long long gaps[GAPBUCKETS];
+    unsigned long long span;            // microseconds covered by the gaps
+    char *text;
+    size_t len,size;
+
+    ww_decoder decoder;
+    int skipping;                       // the words before the first 0x121 belong to the piece before
+    int finishing;                      // past 'end', carry on to the next 0x121
+    int done;
+    unsigned long last;                 // time of the word before
+    int last_stamped;
+    unsigned long cmd_start;            // time of the 0x121 of the command being decoded
+    int cmd_stamped;
+} piece;
+
+static piece pieces[MAXTHREADS];
+
+// returns the length of the frame at 'p' if there is a good one there, otherwise 0
+static size_t frame_at(const unsigned char *p, const unsigned char *limit, int *badsum) {
+    size_t n, i;
+    unsigned char sum = 0;
+
+    *badsum = 0;
+    if (p[0] != BINSYNC || p+1 >= limit || !(n = frame_length(p[1])) || p+n > limit) return 0;
+    for (i = 1; i < n; i++)
+       sum += p[i];
+    if (sum) {
+       *badsum = 1;
+       return 0;
+    }
+    return n;
+}
+
+// returns the first place from 'p' on where a frame starts and the next one does too, or
+// the capture ends, or 'limit' if there isn't one
+static const unsigned char *chained_frame(const unsigned char *p, const unsigned char *limit) {
+    size_t n;
+    int badsum;
+
+    for (; p < limit; p++) {
+       if ((n = frame_at(p,limit,&badsum)) && (p+n == limit || frame_at(p+n,limit,&badsum)))
+          return p;
+    }
+    return limit;
+}
+
+// adds a character to the piece's text
+static void put(piece *p, char c) {
+    if (!p->text_wanted) return;
+    if (p->len == p->size && !(p->text = realloc(p->text,p->size = p->size ? p->size*2 : 4096))) {
+       perror("realloc");
+       exit(1);
+    }
+    p->text[p->len++] = c;
+}
+
+// types the command just completed by ww_decode() the way ASCII mode does, with a newline
+// for the end of a line
+static void type(piece *p) {
+    char typed[2];
+    unsigned char i, n = ww_type(&p->decoder,p->pitch,typed);
+
+    for (i = 0; i < n; i++)
+       put(p,typed[i] == '\r' ? '\n' : typed[i]);
+}
+
+// decodes one BUS word, 'stamped' if 't' is the time it arrived
+static void word(piece *p, unsigned int w, int stamped, unsigned long t) {
+    unsigned long gap, end;
+    int bucket, end_stamped;
+    timing *tm;
+
+    if (p->skipping) {
+       if (w != WWADDRESS) return;
+       p->skipping = 0;
+    }
+    if (p->finishing && w == WWADDRESS)
+       p->done = 1;                     // the next piece starts here, this word only finishes the command before
+    else {
+       ++p->words;
+       if (stamped) ++p->stamped;
+    }
+    if (stamped && p->last_stamped) {
+       gap = (t - p->last) & 0xFFFFFFFFUL;   // the reader's clock is 32 bits
+       for (bucket = 0; gap >> bucket; bucket++);
+       ++p->gaps[bucket];
+       p->span += gap;
+    }
+
+    if (ww_decode(&p->decoder,w)) {
+       ++p->cmds[p->decoder.index];
+       type(p);
+       end = (w & 0x100) ? p->last : t;         // WWARGS_ANY commands are finished by the next address word
+       end_stamped = (w & 0x100) ? p->last_stamped : stamped;
+       if (p->cmd_stamped && end_stamped) {
+          tm = &p->time[p->decoder.index];
+          gap = (end - p->cmd_start) & 0xFFFFFFFFUL;
+          if (!tm->count || gap < tm->min) tm->min = gap;
+          if (gap > tm->max) tm->max = gap;
+          tm->total += gap;
+          ++tm->count;
+       }
+    }
+    if (w == WWADDRESS) {
+       p->cmd_start = t;
+       p->cmd_stamped = stamped;
+    }
+    p->last = t;
+    p->last_stamped = stamped;
+}
+
+// decodes the lines of a HEX listing, skipping anything that isn't a BUS word
+static void scan_text(piece *p) {
+    const unsigned char *q = p->start, *eol;
+    unsigned int w;
+    unsigned long t;
+    int digits, stamped;
+
+    if (q > p->base && q[-1] != '\n') { // not at the start of a line...
+       while (q < p->limit && *q != '\n') ++q;  // ...so start at the next one
+       if (q < p->limit) ++q;
+    }
+    for (; q < p->limit && !p->done; q = eol+1) {
+       if (q >= p->end) p->finishing = 1;
+       if (!(eol = memchr(q,'\n',p->limit-q))) eol = p->limit;
+       if (eol-q < 3 || q[0] != '0' || (q[1] != 'x' && q[1] != 'X')) {
+          if (!p->finishing && eol-q > 1) p->skipped += eol-q+1;  // not counting blank lines
+          continue;
+       }
+       for (q += 2, w = 0, digits = 0; q < eol; q++, digits++) {
+          if (*q >= '0' && *q <= '9')      w = w*16 + (*q - '0');
+          else if (*q >= 'A' && *q <= 'F') w = w*16 + (*q - 'A' + 10);
+          else if (*q >= 'a' && *q <= 'f') w = w*16 + (*q - 'a' + 10);
+          else break;
+       }
+       if (!digits) continue;
+       while (q < eol && (*q == ' ' || *q == '\t')) ++q;
+       for (t = 0, stamped = 0; q < eol && *q >= '0' && *q <= '9'; q++, stamped = 1)
+          t = t*10 + (*q - '0');
+       word(p,w & 0x1FF,stamped,t);
+    }
+}
+
+// decodes the frames of a binary capture, the same way host/wwbindec.c does
+static void scan_binary(piece *p) {
+    const unsigned char *q = p->start, *packed, *gaps;
+    unsigned int bits, nbits, n, i, stamped;
+    unsigned long t;
+    size_t len;
+    int badsum;
+
+    if (p->skipping) q = chained_frame(q,p->limit);
+    while (q < p->limit && !p->done) {
+       if (q >= p->end) p->finishing = 1;
+       if (!(len = frame_at(q,p->limit,&badsum))) {
+          if (!p->finishing) {
+             if (badsum) ++p->bad;
+             ++p->skipped;
+          }
+          ++q;                          // resynchronize just past this byte
+          continue;
+       }
+       if (!p->finishing) ++p->frames;
+       n = q[1] & 0x0F;
+       stamped = (q[1] >> 4) == BINSTAMPED;
+       packed = q + (stamped ? 6 : 2);
+       gaps = packed + (9*n+7)/8;
+       t = stamped ? q[2] | (unsigned long)q[3]<<8 | (unsigned long)q[4]<<16 | (unsigned long)q[5]<<24 : 0;
+       for (i = 0, bits = 0, nbits = 0; i < n && !p->done; i++) {
+          while (nbits < 9) {
+             bits |= (unsigned int)*packed++ << nbits;
+             nbits += 8;
+          }
+          if (i && stamped) {
+             t = (t + (gaps[0] | gaps[1]<<8)) & 0xFFFFFFFFUL;
+             gaps += 2;
+          }
+          word(p,bits & 0x1FF,stamped,t);
+          bits >>= 9;
+          nbits -= 9;
+       }
+       q += len;
+    }
+}
+
+static void *scan(void *arg) {
+    piece *p = arg;
+
+    ww_decode_init(&p->decoder);
+    if (p->binary)
+       scan_binary(p);
+    else
+       scan_text(p);
+    return NULL;
+}
+
+// returns TRUE if the capture looks like binary mode output
+static int is_binary(const unsigned char *buf, size_t len) {
+    if (len > 65536) len = 65536;
+    return chained_frame(buf,buf+len) < buf+len;
+}
+
+// decodes the capture with 'threads' threads, leaving the totals in pieces[0]
+static void analyze(const unsigned char *buf, size_t len, int threads, int pitch, int text_wanted) {
+    pthread_t id[MAXTHREADS];
+    piece *p, *all = &pieces[0];
+    int binary = is_binary(buf,len), i, j;
+
+    for (i = 0; i < threads; i++) {
+       p = &pieces[i];
+       free(p->text);
+       memset(p,0,sizeof(*p));
+       p->base = buf;
+       p->start = buf + len/threads*i;
+       p->end = (i == threads-1) ? buf+len : buf + len/threads*(i+1);
+       p->limit = buf+len;
+       p->binary = binary;
+       p->pitch = pitch;
+       p->text_wanted = text_wanted;
+       p->skipping = (i != 0);
+       if (pthread_create(&id[i],NULL,scan,p)) {
+          perror("pthread_create");
+          exit(1);
+       }
+    }
+    for (i = 0; i < threads; i++)
+       pthread_join(id[i],NULL);
+
+    for (i = 1; i < threads; i++) {     // add up the pieces in pieces[0]
+       p = &pieces[i];
+       all->words += p->words;
+       all->stamped += p->stamped;
+       all->frames += p->frames;
+       all->bad += p->bad;
+       all->skipped += p->skipped;
+       all->span += p->span;
+       for (j = 0; j < GAPBUCKETS; j++)
+          all->gaps[j] += p->gaps[j];
+       for (j = 0; j <= WWCMDS; j++) {
+          all->cmds[j] += p->cmds[j];
+          if (!p->time[j].count) continue;
+          if (!all->time[j].count || p->time[j].min < all->time[j].min) all->time[j].min = p->time[j].min;
+          if (p->time[j].max > all->time[j].max) all->time[j].max = p->time[j].max;
+          all->time[j].total += p->time[j].total;
+          all->time[j].count += p->time[j].count;
+       }
+    }
+}
+
+// prints a histogram bar for 'n' out of 'most'
+static void bar(unsigned long long n, unsigned long long most) {
+    int i, width = most ? (int)((n*BARWIDTH + most-1) / most) : 0;
+
+    for (i = 0; i < width; i++)
+       fputc('#',stderr);
+    fputc('\n',stderr);
+}
+
+static void report(const char *name, size_t len, int threads, double seconds) {
+    piece *all = &pieces[0];
+    unsigned long long commands = 0, most = 0;
+    char label[48];
+    int i, first, last;
+
+    fprintf(stderr,"%s: %s, %zu bytes, %d thread%s, %.3f s (%.1f MB/s)\n",name,
+            all->binary ? "binary capture" : "HEX listing",len,threads,threads == 1 ? "" : "s",
+            seconds,seconds > 0 ? len/seconds/1e6 : 0.0);
+    fprintf(stderr,"%llu BUS words, %llu with timestamps, %llu bytes skipped",all->words,all->stamped,all->skipped);
+    if (all->binary)
+       fprintf(stderr,", %llu frames, %llu bad frames",all->frames,all->bad);
+    fprintf(stderr,"\n");
+    if (all->span)
+       fprintf(stderr,"the capture covers %.3f s of BUS traffic, %.0f words/s\n",all->span/1e6,
+               all->stamped*1e6/all->span);
+
+    for (i = 0; i <= WWCMDS; i++) {
+       commands += all->cmds[i];
+       if (all->cmds[i] > most) most = all->cmds[i];
+    }
+    if (!commands) return;
+    fprintf(stderr,"\n%-12s %12s %7s %9s %9s %9s\n","command","count","%","min us","avg us","max us");
+    for (i = 0; i <= WWCMDS; i++) {
+       if (!all->cmds[i]) continue;
+       fprintf(stderr,"%-12s %12llu %6.2f%%",ww_cmdname[i],all->cmds[i],100.0*all->cmds[i]/commands);
+       if (all->time[i].count)
+          fprintf(stderr," %9lu %9llu %9lu ",all->time[i].min,all->time[i].total/all->time[i].count,all->time[i].max);
+       else
+          fprintf(stderr," %9s %9s %9s ","","","");
+       bar(all->cmds[i],most);
+    }
+
+    for (i = 0, first = -1, last = -1, most = 0; i < GAPBUCKETS; i++) {
+       if (all->gaps[i] && first < 0) first = i;
+       if (all->gaps[i]) last = i;
+       if (all->gaps[i] > most) most = all->gaps[i];
+    }
+    if (last < 0) return;
+    fprintf(stderr,"\n%23s %12s\n","gap between words","count");
+    for (i = first; i <= last; i++) {
+       if (i < 2)
+          snprintf(label,sizeof(label),"%d us",i);
+       else
+          snprintf(label,sizeof(label),"%lu - %lu us",1UL<<(i-1),(1UL<<i)-1);
+       fprintf(stderr,"%23s ",label);
+       fprintf(stderr,"%12llu ",all->gaps[i]);
+       bar(all->gaps[i],most);
+    }
+}
+
+// returns the number of bytes in a size such as 64K, 100M or 4G
+static size_t parse_size(const char *s) {
+    char *end;
+    double n = strtod(s,&end);
+
+    switch (*end) {
+       case 'k': case 'K': n *= 1024; break;
+       case 'm': case 'M': n *= 1024*1024; break;
+       case 'g': case 'G': n *= 1024.0*1024*1024; break;
+    }
+    return (size_t)n;
+}
+
+// writes a HEX listing with timestamps of about 'size' bytes: text typed at a realistic
+// pace in 12 pitch, a carrier return every line, now and then a backspace and an erase
+static void generate(const char *name, size_t size) {
+    static const char *words[] = {"the","quick","brown","fox","jumps","over","lazy","dog","Wheelwriter",
+                                  "BUS","Printer","Board","1234567890","(and),","reader;","its","done."};
+    unsigned char code_of[256];
+    unsigned long long written = 0;
+    unsigned long t = 0, seed = 1;
+    unsigned int column = 0, i;
+    const char *s;
+    FILE *f;
+
+#define RANDOM(n) (((seed = seed*1103515245 + 12345) >> 16) % (n))
+#define WORD(w,dt) (t = (t + (dt)) & 0xFFFFFFFFUL, \
+                    written += fprintf(f,(w) == WWADDRESS ? "\n0x%03X %lu\n" : "0x%03X %lu\n",(unsigned int)(w),t))
+
+    memset(code_of,0,sizeof(code_of));  // ASCII to printwheel code, 0 = space
+    for (i = sizeof(printwheel); i > 0; i--)
+       code_of[(unsigned char)printwheel[i-1]] = i;
+    if (!(f = fopen(name,"w"))) {
+       perror(name);
+       exit(1);
+    }
+    setvbuf(f,NULL,_IOFBF,1<<20);
+    while (written < size) {
+       for (s = words[RANDOM(sizeof(words)/sizeof(words[0]))]; ; s++) {
+          WORD(WWADDRESS,60000 + RANDOM(150000));     // a keystroke every 60 to 210 ms...
+          WORD(0x003,117);                            // ...with each word and its acknowledge taking 117 us
+          WORD(*s ? code_of[(unsigned char)*s] : 0,117);
+          WORD(TWELVEPITCH,117);
+          ++column;
+          if (!*s) break;
+          if (!RANDOM(60)) {                          // a typing mistake, backspace and erase it
+             WORD(WWADDRESS,150000);
+             WORD(0x006,117);
+             WORD(0x000,117);
+             WORD(TWELVEPITCH,117);
+             WORD(WWADDRESS,60000);
+             WORD(0x004,117);
+             WORD(code_of[(unsigned char)*s],117);
+             WORD(TWELVEPITCH,117);
+             WORD(WWADDRESS,150000);
+             WORD(0x003,117);
+             WORD(code_of[(unsigned char)*s],117);
+             WORD(TWELVEPITCH,117);
+          }
+       }
+       if (column > 60) {                             // carrier return and paper up a line
+          WORD(WWADDRESS,300000);
+          WORD(0x006,117);
+          WORD((column*TWELVEPITCH) >> 8,117);
+          WORD((column*TWELVEPITCH) & 0xFF,117);
+          WORD(WWADDRESS,1000);
+          WORD(0x005,117);
+          WORD(0x80|LINESPACING,117);
+          column = 0;
+       }
+    }
+#undef WORD
+#undef RANDOM
+    if (fclose(f)) {
+       perror(name);
+       exit(1);
+    }
+    fprintf(stderr,"%s: %llu bytes\n",name,written);
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+// times decoding the capture with 1, 2, 4... threads up to 'threads'
+static void benchmark(const unsigned char *buf, size_t len, int threads, int pitch) {
+    unsigned long long words = 0, commands, expected = 0;
+    double start, seconds, single = 0;
+    int n, i;
+
+    analyze(buf,len,threads,pitch,0);   // read the capture into the page cache first
+    printf("%7s %9s %9s %12s %8s\n","threads","seconds","MB/s","words/s","speedup");
+    for (n = 1; ; n = (n*2 > threads && n < threads) ? threads : n*2) {
+       start = now();
+       analyze(buf,len,n,pitch,0);
+       seconds = now() - start;
+       for (i = 0, commands = 0; i <= WWCMDS; i++)
+          commands += pieces[0].cmds[i];
+       if (n == 1) {
+          single = seconds;
+          words = pieces[0].words;
+          expected = commands;
+       }
+       printf("%7d %9.3f %9.1f %12.0f %7.2fx%s\n",n,seconds,len/seconds/1e6,pieces[0].words/seconds,
+              single/seconds,(pieces[0].words != words || commands != expected) ? "  results differ!" : "");
+       if (n >= threads) break;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int c, fd, threads = (int)sysconf(_SC_NPROCESSORS_ONLN), pitch = TWELVEPITCH, quiet = 0, bench = 0, i;
+    size_t gen = 0;
+    struct stat st;
+    unsigned char *buf;
+    double start;
+
+    while ((c = getopt(argc,argv,"j:p:qg:b")) != -1) {
+       switch (c) {
+          case 'j': threads = atoi(optarg); break;
+          case 'p': pitch = atoi(optarg) == 10 ? TENPITCH : atoi(optarg) == 15 ? FIFTEENPITCH : TWELVEPITCH; break;
+          case 'q': quiet = 1; break;
+          case 'g': gen = parse_size(optarg); break;
+          case 'b': bench = 1; break;
+          default:
+             fprintf(stderr,"usage: %s [-j threads] [-p pitch] [-q] capture\n"
+                            "       %s -g size capture\n"
+                            "       %s -b [-j threads] capture\n",argv[0],argv[0],argv[0]);
+             return 1;
+       }
+    }
+    if (optind >= argc) {
+       fprintf(stderr,"%s: no capture file\n",argv[0]);
+       return 1;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > MAXTHREADS) threads = MAXTHREADS;
+    if (gen) {
+       generate(argv[optind],gen);
+       return 0;
+    }
+
+    if ((fd = open(argv[optind],O_RDONLY)) < 0 || fstat(fd,&st)) {
+       perror(argv[optind]);
+       return 1;
+    }
+    if (!st.st_size) {
+       fprintf(stderr,"%s: empty\n",argv[optind]);
+       return 1;
+    }
+    if ((buf = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0)) == MAP_FAILED) {
+       perror("mmap");
+       return 1;
+    }
+    madvise(buf,st.st_size,MADV_SEQUENTIAL);
+    if ((size_t)st.st_size < (size_t)threads * 4096)
+       threads = st.st_size/4096 + 1;   // not worth splitting a small capture
+
+    if (bench) {
+       benchmark(buf,st.st_size,threads,pitch);
+       return 0;
+    }
+    start = now();
+    analyze(buf,st.st_size,threads,pitch,!quiet);
+    for (i = 0; i < threads && !quiet; i++)
+       fwrite(pieces[i].text,1,pieces[i].len,stdout);
+    fflush(stdout);
+    report(argv[optind],st.st_size,threads,now() - start);
+    return 0;
+}
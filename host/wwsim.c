@@ -0,0 +1,176 @@
+// Wheelwriter BUS simulator.
+//
+// Runs the reader firmware natively on Linux and feeds it a recorded stream of BUS words,
+// either at a fixed rate or as fast as the firmware will decode them. The console output
+// goes to stdout, the throughput summary to stderr.
+//
+// build:  gcc -O2 -I. -o wwsim *.c host/hal_host.c host/wwsim.c
+//
+// usage:  wwsim [-x] [-B] [-d] [-r words/s | -t] [-b baud] [-w] [-n] [-s] [-c text] [-e text] [-p link] capture.txt
+//         -x          HEX mode (switch 1 on), the default is ASCII mode
+//         -B          binary mode (switch 4 on)
+//         -d          debug mode (switch 2 on)
+//         -r rate     deliver BUS words at this rate, 0 = as fast as possible (the default).
+//                     the real BUS tops out at 187500/11 = 17045 words/s
+//         -t          deliver BUS words at the times recorded in the capture
+//         -b baud     limit the console to this baud rate, 0 = no limit (the default)
+//         -w          the capture is already wire level, don't add acknowledge words
+//         -n          don't acknowledge the words the reader sends, e.g. with the "send" command
+//         -s          list the words the reader sends on stderr
+//         -c text     type this on the console when the simulation starts, e.g. -c $'mode page\r'
+//         -e text     type this on the console after the last BUS word, e.g. -e $'?\r' for the statistics
+//         -p link     send the console output to a new pseudo-terminal instead of stdout, with
+//                     'link' a symbolic link to it, so it can be read like a reader's serial port
+//
+// The console takes a command once it gets the CR that ends the line, so the text for -c and
+// -e needs one, as in the bash $'...\r' quoting above.
+//
+// The capture is the reader's own HEX mode output: every line that starts with "0x" is a
+// BUS word, optionally followed by the time it arrived in microseconds (debug mode).
+// Since the reader removes the Printer Board's acknowledges, an all zeros acknowledge is
+// put back after each word unless -w is given.
+//
+// With -p, the simulation starts straight away and the output waits in the pseudo-terminal
+// until something opens it, holding up the simulation once that fills. Before exiting,
+// wwsim waits for what is left there to be read, since closing the pseudo-terminal throws
+// it away.
+
+#define _GNU_SOURCE                     // posix_openpt() and cfmakeraw()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include "hal_host.h"
+
+static unsigned int *words;             // the capture
+static unsigned long *times;            // and the arrival times, if the capture has them
+static unsigned long count;
+
+static const char *pty_link;            // -p
+static int pty_slave = -1;              // kept open so the output waits for a reader instead of being lost
+
+static void add_word(unsigned int w, unsigned long t) {
+    static unsigned long size = 0;
+
+    if (count == size) {
+       size = size ? size*2 : 4096;
+       words = realloc(words,size*sizeof(*words));
+       times = realloc(times,size*sizeof(*times));
+       if (!words || !times) {
+          perror("realloc");
+          exit(1);
+       }
+    }
+    words[count] = w;
+    times[count] = t;
+    ++count;
+}
+
+// returns the number of words that have a timestamp
+static unsigned long load_capture(const char *name, int add_acks) {
+    FILE *f;
+    char line[128];
+    unsigned int w;
+    unsigned long t, stamped = 0;
+
+    if (!(f = fopen(name,"r"))) {
+       perror(name);
+       exit(1);
+    }
+    while (fgets(line,sizeof(line),f)) {
+       if (strncmp(line,"0x",2) && strncmp(line,"0X",2)) continue;
+       switch (sscanf(line,"%x %lu",&w,&t)) {
+          case 2:
+             ++stamped;
+             break;
+          case 1:
+             t = count ? times[count-1] : 0;
+             break;
+          default:
+             continue;
+       }
+       add_word(w & 0x1FF,t);
+       if (add_acks) add_word(0x000,t);
+    }
+    fclose(f);
+    return stamped;
+}
+
+// waits for the output left in the pseudo-terminal to be read, or 10 seconds without any
+// of it going, then removes the link
+static void close_pty(void) {
+    int waiting, before = -1, still = 0;
+
+    fflush(NULL);
+    while (!ioctl(pty_slave,FIONREAD,&waiting) && waiting && still < 100) {
+       still = waiting == before ? still+1 : 0;
+       before = waiting;
+       usleep(100000);
+    }
+    unlink(pty_link);
+}
+
+// sends the console output to a new pseudo-terminal, raw so the reader's CR LF come out as sent
+static void open_pty(const char *link) {
+    int master;
+    struct termios t;
+
+    if ((master = posix_openpt(O_RDWR|O_NOCTTY)) < 0 || grantpt(master) || unlockpt(master) ||
+        (pty_slave = open(ptsname(master),O_RDWR|O_NOCTTY)) < 0 || tcgetattr(pty_slave,&t)) {
+       perror("pseudo-terminal");
+       exit(1);
+    }
+    cfmakeraw(&t);
+    tcsetattr(pty_slave,TCSANOW,&t);
+    unlink(link);
+    if (symlink(ptsname(master),link)) {
+       perror(link);
+       exit(1);
+    }
+    hal_console_output(master);
+    pty_link = link;
+    atexit(close_pty);
+    fprintf(stderr,"console on %s -> %s\n",link,ptsname(master));
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long rate = 0;
+    int c, add_acks = 1, replay = 0;
+    const char *console_start = NULL, *console_end = NULL, *pty = NULL;
+
+    while ((c = getopt(argc,argv,"xBdr:tb:wnsc:e:p:")) != -1) {
+       switch (c) {
+          case 'x': switch1 = 0; break;
+          case 'B': switch4 = 0; break;
+          case 'd': switch2 = 0; break;
+          case 'r': rate = strtoul(optarg,NULL,0); break;
+          case 't': replay = 1; break;
+          case 'b': hal_console_baud(strtoul(optarg,NULL,0)); break;
+          case 'w': add_acks = 0; break;
+          case 'n': hal_bus_acks(0); break;
+          case 's': hal_bus_list(1); break;
+          case 'c': console_start = optarg; break;
+          case 'e': console_end = optarg; break;
+          case 'p': pty = optarg; break;
+          default:
+             fprintf(stderr,"usage: %s [-x] [-B] [-d] [-r words/s | -t] [-b baud] [-w] [-n] [-s] [-c text] [-e text] [-p link] capture.txt\n",argv[0]);
+             return 1;
+       }
+    }
+    if (optind >= argc) {
+       fprintf(stderr,"%s: no capture file\n",argv[0]);
+       return 1;
+    }
+    if (load_capture(argv[optind],add_acks) == 0 && replay) {
+       fprintf(stderr,"%s: %s has no timestamps\n",argv[0],argv[optind]);
+       return 1;
+    }
+    if (pty) open_pty(pty);
+    hal_bus_feed(words,replay ? times : NULL,count,rate);
+    hal_console_input(console_start,console_end);
+    firmware_main();                    // returns only through hal_poll() when the capture is done
+    return 0;
+}
@@ -17,9 +17,18 @@
 // Read Wheelwriter BUS using serial mode 2 and a 12Mhz clock.
 
 #include <stdio.h>
-#include <reg420.h>
+#include "hal.h"
+#include "clock.h"
+#include "wwproto.h"
 #include "uart12.h"
+#include "timer2.h"
 #include "watchdog.h"
+#include "binout.h"
+#include "console.h"
+#include "capture.h"
+#include "page.h"
+#include "printer.h"
+#include "reader.h"
 
 #define CR    0x0D
 #define LF    0x0A
@@ -28,36 +37,51 @@
 #define SPACE 0x20
 #define DEL   0x7F
 
-// 12,000,000 Hz /12 = 1,000,000 Hz = 1.0 microsecond clock period
-// 50 milliseconds / 1.0 microseconds per clock = 50,000 clocks
-#define RELOADHI (65536-50000)/256
-#define RELOADLO (65536-50000)&255
+// timer 0 counts once every TIMER_US microseconds (FOSC/12), so a TICK_MS tick is
+// TICK_COUNTS counts and timer 0 is reloaded with 65536-TICK_COUNTS, see clock.h
+#define RELOADHI (65536-TICK_COUNTS)/256
+#define RELOADLO (65536-TICK_COUNTS)&255
+#define RELOAD   (65536-TICK_COUNTS)
 
-#define FIFTEENPITCH 8                  // number of microspaces for each character on the 15P printwheel
-#define TWELVEPITCH 10                  // number of microspaces for each character on the 12P printwheel
-#define TENPITCH 12                     // number of microspaces for each character on the 10P printwheel
+#define WATCHDOG_INTERVAL 2             // 2^23 clocks, 699 milliseconds at 12 MHz
 
-sbit switch1 = P0^0;                    // dip switch connected to pin 5 (ASCII/HEX mode)
-sbit switch2 = P0^1;                    // dip switch connected to pin 6 (debug mode)  
-sbit switch3 = P0^2;                    // dip switch connected to pin 7 (add linefeeds)
-sbit switch4 = P0^3;                    // dip switch connected to pin 8 (not used)  
+#if WATCHDOG_MS(WATCHDOG_INTERVAL) < 4*TICK_MS
+#error "the watchdog interval is too short for Timer0_ISR() to keep resetting it"
+#endif
 
-sbit redLED =   P0^4;                   // red LED connected to pin 35 0=on, 1=off
-sbit amberLED = P0^5;                   // amber LED connected to pin 34 0=on, 1=off
-sbit greenLED = P0^6;                   // green LED connected to pin 33 0=on, 1=off
+#define SUMMARY_SECONDS 10              // seconds between summaries in stats mode, unless "stats every" says otherwise
 
 code char title[]     = "DS89C440 Serial Mode 2 Read Version 1.1.0";
 code char compiled[]  = "Compiled " __DATE__ " at " __TIME__;
 code char copyright[] = "Copyright 2018 Jim Loos";
 
-char microSpacesPerCharacter = 0;
+unsigned char microSpacesPerCharacter = 0;
 volatile unsigned char tickcount = 0;
+volatile bit alive = 0;                 // set each time around the main loop, see Timer0_ISR()
+unsigned long idle_us;                  // microseconds spent in idle mode since the statistics were cleared
+unsigned long stats_start;              // when the statistics were cleared
+unsigned char output_mode = MODE_SWITCHES; // set by the "mode" console command
+unsigned char timestamps = SETTING_SWITCHES; // set by the "time" console command
+unsigned char stats_seconds = 0;        // set by the "stats every" console command
+unsigned char stats_countdown = 0;      // seconds until the next statistics report
+ww_decoder xdata decoder;               // decoder state for ASCII mode
+unsigned char xdata decode_us[WWCMDS+1]; // worst case microseconds taken to decode each command in ASCII mode
+unsigned long summary_words;            // BUS words since the last summary in stats mode
+unsigned long summary_start;            // when the last summary was sent
+unsigned int burst_window;              // bits 31-16 of the time of the last frame, a 65.536 millisecond window
+unsigned int burst_words;               // BUS words in that window
+unsigned int burst_peak;                // most BUS words in one window since the last summary
+unsigned int xdata summary_commands[ACT_HORIZONTAL+1]; // commands since the last summary, indexed by enum ww_action
 
 
 // ======================= timer0 ISR =======================
-// every 50 milliseconds, 20 times per second
+// every 50 milliseconds, 20 times per second. the main loop
+// spends most of its time in idle mode, so the watchdog and
+// the green LED are looked after here, but only while the
+// main loop is still coming around.
 // ==========================================================
-void Timer0_ISR() interrupt 1 {
+void Timer0_ISR() INTERRUPT(1) {
+    static unsigned char ledticks = 0;
 
     TL0 = RELOADLO;     			    //load timer 0 low byte
     TH0 = RELOADHI;     			    //load timer 0 high byte
@@ -65,6 +89,18 @@ void Timer0_ISR() interrupt 1 {
     if (tickcount) {
        tickcount--;
     }
+    if (alive) {                        // the main loop has been around since the last tick...
+       alive = 0;
+       TA = 0xAA;                       // ...'pet' the watchdog, as reset_watchdog() does.
+       TA = 0x55;                       // not a call, reset_watchdog() belongs to main()
+       RWT = 1;
+       if (++ledticks == 10) {          // every half second...
+          ledticks = 0;
+          greenLED = !greenLED;         // ...toggle the green LED
+       }
+    }
+    tx1_tick();                         // time out the acknowledge for a word sent on the BUS
+    rx1_tick();                         // finish a frame from the BUS once the BUS goes quiet
 }
 
 //------------------------------------------------------------
@@ -80,107 +116,282 @@ void init_timer0(){
 	TR0 = 1;                     	    // run timer 0
 }
 
-// convert printwheel character to ASCII
-code const char printwheel[96] = {
-// a    n    r    m    c    s    d    h    l    f    k    ,    V    _    G    U  
-  0x61,0x6E,0x72,0x6D,0x63,0x73,0x64,0x68,0x6C,0x66,0x6B,0x2C,0x56,0x2D,0x47,0x55,
-// F    B    Z    H    P    )    R    L    S    N    C    T    D    E    I    A       
-  0x46,0x42,0x5A,0x48,0x50,0x29,0x52,0x4C,0x53,0x4E,0x43,0x54,0x44,0x45,0x49,0x41,
-// J    O    (    M    .    Y    ,    /    W    9    K    3    X    1    2    0 
-  0x4A,0x4F,0x28,0x4D,0x2E,0x59,0x2C,0x2F,0x57,0x39,0x4B,0x33,0x58,0x31,0x32,0x30,
-// 5    4    6    8    7    *    $    #    %    ¢    +    ±    @    Q    &    ]
-  0x35,0x34,0x36,0x38,0x37,0x2A,0x24,0x23,0x25,0xA2,0x2B,0xB1,0x40,0x51,0x26,0x5D,
-// [    ³    ²    º    §    ¶    ½    ¼    !    ?    "    '    =    :    -    ;   
-  0x5B,0xB3,0xB2,0xBA,0xA7,0xB6,0xBD,0xBC,0x21,0x3F,0x22,0x60,0x3D,0x3A,0x5F,0x3B,
-// x    q    v    z    w    j    .    y    b    g    u    p    i    t    o    e   
-  0x78,0x71,0x76,0x7A,0x77,0x6A,0x2E,0x79,0x62,0x67,0x75,0x70,0x69,0x74,0x6F,0x65};  
-
-//------------------------------------------------------------------------------------------
-// parses the data stream consisting of the 9 bit words received from the Wheelwriter BUS. 
-// if ASCII mode, (switch 1 off), transmits the decoded ASCII character out through Serial0, 
-// otherwise (switch 1 on) transmits the hexadecimal value of the word through Serial0.
-//------------------------------------------------------------------------------------------
-void parseWWdata(unsigned int WWdata) {
-    static char state = 0;
-    int n;
-
-    if (switch1) {                      // if switch 1 is off (ASCII Mode)
-        switch (state) {
-            case 0:                     // waiting for first data word from Wheelwriter...
-                if (WWdata == 0x121)    // all commands must start with 0x121...
-                   state = 1;
-                break;
-            case 1:                     // 0x121 has been received...
-                switch (WWdata) {
-                    case 0x003:         // 0x121,0x003 is start of alpha-numeric character sequence
-                        state = 2;
-                        break;
-                    case 0x004:         // 0x121,0x004 is start of erase sequence
-                        putchar(SPACE); // overwrite the character with space
-                        putchar(BS);   
-                        state = 0;
-                        break;
-                    case 0x005:         // 0x121,0x005 is start of vertical movement sequence
-                        state = 6;
-                        break;          
-                    case 0x006:         // 0x121,0x006 is start of horizontal movement sequence
-                        state = 3;
-                        break;
-                    default:
-                        state = 0;
-            } // switch (WWdata)
-                break;
-            case 2:                     // 0x121,0x003 has been received...          
-                if (WWdata)             // 0x121,0x003,printwheel code
-                   putchar(printwheel[(WWdata-1)]); 
-                else
-                   putchar(SPACE);      // 0x121,0x003,0x000 is the sequence for SPACE
-                state = 0;
-                break;
-            case 3:                     // 0x121,0x006 has been received...
-                if (WWdata & 0x080)     // if bit 7 is set...         
-                   state = 4;           // 0x121,0x006,0x080 is horizontal movement to the right...
-                else                    // else...
-                   state = 5;           // 0x121,0x006,0x000 is horizontal movement to the left...
-                break;
-           case 4:                     // 0x121,0x006,0x080 has been received, move carrier to the right...
-                state = 0;
-                if (WWdata>uSpacesPerChar) // if more than one space, must be tab
-                    putchar(HT);
-                else
-                    putchar(SP);
-                break;
-            case 5:                     // 0x121,0x006,0x000 has been received, move carrier to the left...
-                if (WWdata == microSpacesPerCharacter) 
-                   putchar(BS);
-                state = 0;
-                break;
-            case 6:                     // 0x121,0x005 has been received...
-                if ((WWdata&0x1F) == uLinesPerLine)
-                   putchar(CR);                // 0x121,0x005,0x090 is the sequence for paper up one line (for 10P, 12P and PS printwheels)
-                state = 0;
-        }   // switch (state)
-    }  // if (switch1)
+//------------------------------------------------------------------------------------------
+// returns the count in timer 0, which goes up once every TIMER_US microseconds from RELOAD
+// to 65535.
+//------------------------------------------------------------------------------------------
+unsigned int read_timer0(void) {
+    unsigned char hi,lo;
+
+    do {
+       hi = TH0;
+       lo = TL0;
+    } while (hi != TH0);                // read again if TL0 rolled over into TH0
+    return (((unsigned int)hi<<8)|lo);
+}
+
+//------------------------------------------------------------------------------------------
+// returns the microseconds since 'start' was read from timer 0, up to 50 milliseconds.
+//------------------------------------------------------------------------------------------
+unsigned int elapsed_timer0(unsigned int start) {
+    unsigned int now = read_timer0();
+
+    if (now >= start)
+       return ((now - start)*TIMER_US);
+    return (((now - RELOAD) + (unsigned int)(65536UL - start))*TIMER_US);  // timer 0 was reloaded in between
+}
+
+//------------------------------------------------------------------------------------------
+// returns the output mode, either as set from the console or from the switches: binary
+// mode if switch 4 is on, otherwise ASCII mode if switch 1 is off or HEX mode if it's on.
+//------------------------------------------------------------------------------------------
+unsigned char current_mode(void) {
+    if (output_mode != MODE_SWITCHES)
+       return (output_mode);
+    if (!switch4)
+       return (MODE_BINARY);
+    return (switch1 ? MODE_ASCII : MODE_HEX);
+}
+
+//------------------------------------------------------------------------------------------
+// returns TRUE if the HEX and binary output include timestamps, either as set from the
+// console or from switch 2 (debug mode).
+//------------------------------------------------------------------------------------------
+bit timestamps_on(void) {
+    if (timestamps == SETTING_SWITCHES)
+       return (!switch2);
+    return (timestamps == SETTING_ON);
+}
+
+//------------------------------------------------------------------------------------------
+// keeps the worst case time taken to decode the command just completed in 'decoder' in
+// decode_us[]. 'start' is timer 0 when the decoding began. the time the command takes to
+// type isn't included, since putchar() waits whenever the TX buffer is full.
+//------------------------------------------------------------------------------------------
+static void time_decode(unsigned int start) {
+    unsigned int us;
+
+    us = elapsed_timer0(start);
+    if (us > 255) us = 255;
+    if (us > decode_us[decoder.index]) decode_us[decoder.index] = us;
+}
+
+//------------------------------------------------------------------------------------------
+// sends the command just completed in 'decoder' to the console, as ASCII or, in page mode,
+// into the line being typed.
+//------------------------------------------------------------------------------------------
+static void typeWWcommand(unsigned char mode) {
+    char typed[2];
+    unsigned char i,n;
+
+    if (mode == MODE_PAGE) {
+       page_command(&decoder);
+       return;
+    }
+    n = ww_type(&decoder,microSpacesPerCharacter,typed);
+    for (i = 0; i < n; i++)
+       putchar(typed[i]);
+}
+
+//------------------------------------------------------------------------------------------
+// counts 'n' BUS words, the first of them arriving at time 't', for stats mode.
+//------------------------------------------------------------------------------------------
+static void count_words(unsigned char n, unsigned long t) {
+    summary_words += n;
+    if ((unsigned int)(t >> 16) != burst_window) {  // a new window
+       burst_window = t >> 16;
+       burst_words = 0;
+    }
+    burst_words += n;
+    if (burst_words > burst_peak) burst_peak = burst_words;
+}
+
+//------------------------------------------------------------------------------------------
+// counts the command just completed in 'decoder' for stats mode.
+//------------------------------------------------------------------------------------------
+static void count_command(void) {
+    if (summary_commands[decoder.action] != 0xFFFF)  // stops at the top rather than going back to 0
+       ++summary_commands[decoder.action];
+}
+
+//------------------------------------------------------------------------------------------
+// parses one of the 9 bit words received from the Wheelwriter BUS, for each word of a frame
+// in HEX and binary mode and for the words played back from the capture buffer.
+// in binary mode (switch 4 on), transmits the words packed into binary frames through Serial0.
+// in ASCII mode, (switch 1 off), transmits the decoded ASCII character out through Serial0, 
+// in HEX mode (switch 1 on) transmits the hexadecimal value of the word through Serial0.
+// in page mode, set by the console "mode" command, transmits each line once it is finished.
+// in stats mode, also only from the console, counts the words and commands for the summary.
+// the console "mode" command overrides the switches. with timestamps on (debug mode, switch 2
+// on, or the "time" command) the HEX and binary output include WWtime, the time the word
+// arrived in microseconds.
+// in ASCII and page mode the worst case time taken to decode each command is kept in decode_us[].
+//------------------------------------------------------------------------------------------
+void parseWWdata(unsigned int WWdata, unsigned long WWtime) {
+    unsigned int start;
+    unsigned char mode = current_mode();
+
+    if (mode == MODE_BINARY) {
+        bin_timestamps = timestamps_on();
+        bin_put(WWdata,WWtime);
+    }
+    else if (mode == MODE_ASCII || mode == MODE_PAGE) {
+        start = read_timer0();
+        if (!ww_decode(&decoder,WWdata))
+           return;                      // not the end of a command yet
+
+        time_decode(start);
+        typeWWcommand(mode);
+    }  // if (mode == MODE_ASCII || mode == MODE_PAGE)
+    else if (mode == MODE_STATS) {
+        count_words(1,WWtime);
+        if (ww_decode(&decoder,WWdata))
+           count_command();
+    }
     else {                              // not ASCII mode, HEX mode instead
         if (WWdata == 0x121) 
            printf("\n");                // 0x121 starts on a new line
-        printf("0x%03X\n",WWdata);      // print the data as three hex digits 
+        if (timestamps_on())
+           printf("0x%03X %lu\n",WWdata,WWtime); // print the data as three hex digits and the time it arrived
+        else
+           printf("0x%03X\n",WWdata);   // print the data as three hex digits 
     } 
 }
 
+//------------------------------------------------------------------------------------------
+// parses a frame of words received from the Wheelwriter BUS, see serial1_isr(). in ASCII
+// and page mode the frame is decoded as a whole command; frames that aren't one, such as
+// responses from the Printer Board, have nothing to type. in stats mode the frame's words
+// and command are counted. in HEX and binary mode the words go to parseWWdata() one at a
+// time with their arrival times. with "ack off" the acknowledges are in the frames too,
+// and a command may go on into the next frame, so in ASCII, page and stats mode the words
+// other than the acknowledges go to parseWWdata() one at a time instead.
+//------------------------------------------------------------------------------------------
+void parseWWframe(ww_frame xdata *f) {
+    unsigned int start;
+    unsigned char mode = current_mode(), i;
+    unsigned long t = f->time;
+
+    if (!ack_filter && mode != MODE_HEX && mode != MODE_BINARY) {
+        for (i = 0; i < f->count; i++) {
+           if (i) t += f->gap[i-1];
+           if (!(f->flags & WWFRAME_ACK(i)))
+              parseWWdata(ww_frame_word(f,i),t);
+        }
+    }
+    else if (mode == MODE_ASCII || mode == MODE_PAGE) {
+        start = read_timer0();
+        if (ww_decode_frame(&decoder,f)) {
+           time_decode(start);
+           typeWWcommand(mode);
+        }
+    }
+    else if (mode == MODE_STATS) {
+        count_words(f->count,t);
+        if (ww_decode_frame(&decoder,f))
+           count_command();
+    }
+    else {
+        for (i = 0; i < f->count; i++) {
+           if (i) t += f->gap[i-1];
+           parseWWdata(ww_frame_word(f,i),t);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------------------
+// prints the buffer statistics and the worst case time taken to decode each command seen
+// so far.
+//------------------------------------------------------------------------------------------
+void print_stats(void) {
+    uart_stats xdata stats;
+    unsigned char i;
+    unsigned long elapsed;
+
+    get_uart_stats(&stats);
+    printf("\r\nBUS words dropped: %lu overruns: %u acknowledges: %lu missing: %u\r\n",stats.rx1_dropped,stats.rx1_overruns,stats.rx1_acks,stats.rx1_noacks);
+    printf("BUS frame buffer high water: %u worst latency: %lu us\r\n",(unsigned int)stats.rx1_hiwater,stats.rx1_latency);
+    printf("TX buffer high water: %u stalls: %u\r\n",(unsigned int)stats.tx0_hiwater,stats.tx0_stalls);
+    printf("RX buffer high water: %u dropped: %u\r\n",(unsigned int)stats.rx0_hiwater,stats.rx0_dropped);
+    printf("BUS words sent: %lu retries: %lu failed: %u\r\n",stats.tx1_sent,stats.tx1_retries,stats.tx1_failed);
+    elapsed = (micros() - stats_start) / 100;
+    if (elapsed)                        // the microsecond clock wraps after 71 minutes
+       printf("idle: %lu%%\r\n",idle_us / elapsed);
+    for (i = 0; i <= WWCMDS; i++) {
+       if (decode_us[i])
+          printf("%s: %u us\r\n",ww_cmdname[i],(unsigned int)decode_us[i]);
+    }
+}
+
+//------------------------------------------------------------------------------------------
+// sends the one line summary of the BUS traffic since the last one, for stats mode: the
+// BUS words, their average and peak rates per second, the commands of each kind and the
+// words that went without an acknowledge or were dropped since the statistics were
+// cleared. the peak is the busiest 65.536 millisecond window.
+//------------------------------------------------------------------------------------------
+void print_summary(void) {
+    uart_stats xdata stats;
+    unsigned long elapsed;
+
+    get_uart_stats(&stats);
+    elapsed = (micros() - summary_start) / 10000;    // in hundredths of a second
+    printf("%lu words %lu/s peak %lu/s, char %u erase %u vert %u horiz %u other %u, noack %u dropped %lu\r\n",
+           summary_words,elapsed ? summary_words*100 / elapsed : 0,((unsigned long)burst_peak*15625)>>10,
+           summary_commands[ACT_CHARACTER],summary_commands[ACT_ERASE],summary_commands[ACT_VERTICAL],
+           summary_commands[ACT_HORIZONTAL],summary_commands[ACT_OTHER],stats.rx1_noacks,stats.rx1_dropped);
+    clear_summary();
+}
+
+//------------------------------------------------------------------------------------------
+// starts a new stats mode summary, and in stats mode the time to the next one.
+//------------------------------------------------------------------------------------------
+void clear_summary(void) {
+    unsigned char i;
+
+    summary_words = 0;
+    summary_start = micros();
+    burst_words = 0;
+    burst_peak = 0;
+    for (i = 0; i <= ACT_HORIZONTAL; i++)
+       summary_commands[i] = 0;
+    if (current_mode() == MODE_STATS)
+       stats_countdown = stats_seconds ? stats_seconds : SUMMARY_SECONDS;
+}
+
+//------------------------------------------------------------------------------------------
+// sets all the statistics back to zero.
+//------------------------------------------------------------------------------------------
+void clear_stats(void) {
+    unsigned char i;
+
+    clear_uart_stats();
+    idle_us = 0;
+    stats_start = micros();
+    for (i = 0; i <= WWCMDS; i++)
+       decode_us[i] = 0;
+    clear_summary();
+}
+
 
 // MAIN =============================================================
 
 void main(){
 
-    unsigned int loopcounter;
+    unsigned int WWdata;
+    unsigned long WWtime, idle_start;
+    ww_frame xdata *frame;
+    unsigned char i;
+    unsigned int kept;
+    bit warm;
 
     disable_watchdog();
 
 	PMR |= 0x01;					    // enable internal SRAM MOVX memory
+    warm = ((WDCON & 0x44) == 0x04);    // after a watchdog reset the MOVX SRAM still holds what was going on
 	init_serial0(9600);		            // initialize serial 0 for mode 1 at 9600bps
-    init_serial1();                     // initialize serial 1 for mode 2
+    kept = init_serial1(warm);          // initialize serial 1 for mode 2, keeping the BUS frames that were waiting
    	init_timer0();                      // timer 0 interrupts every 50 milliseconds
+    init_timer2();                      // timer 2 is the microsecond clock for BUS word timestamps
 
     printf("\r\n\n%s\r\n%s\r\n%s\r\n\n",title,compiled,copyright);
     switch (WDCON & 0x44) {
@@ -188,7 +399,7 @@ void main(){
             printf("External reset\r\n\n");
             break;
         case 0x04:
-            printf("Watchdog reset\r\n\n");
+            printf("Watchdog reset, %u BUS words kept\r\n\n",kept);
             break;
         case 0x40:
             printf("Power on reset\r\n\n");
@@ -196,23 +407,84 @@ void main(){
         default:
             printf("Unknown reset\r\n\n");
     } // switch (WDCON & 0x44)
+    clr_watchdog();                     // so the next reset reports its own cause
 
     microSpacesPerCharacter=TWELVEPITCH;
-    init_watchdog(2);                   // change WD interval to (1/12MHz)*2^23 =  699.0 milliseconds
+    ww_decode_init(&decoder);
+    if (!warm || !page_resume())        // carry on with the line being typed in page mode...
+       page_init();
+    if (!warm || !capture_resume())     // ...and with the capture
+       capture_init();
+    clear_stats();
+    init_console(9600);
+    init_watchdog(WATCHDOG_INTERVAL);   // change WD interval to 2^23 clocks, see clock.h
     reset_watchdog();
     amberLED = 1;                       // turn off the amber LED
 
 	while(1){
 
-       reset_watchdog();                // 'pet' the watchdog
+       hal_poll();                      // nothing on the hardware, runs the simulated interrupts on the host
+       alive = 1;                       // Timer0_ISR() pets the watchdog and blinks the LED while this keeps happening
 
-       if (++loopcounter==0) {          // every 65536 times through the loop (at about 2Hz)
-          greenLED = !greenLED;         // toggle the green LED
+	   if (WWframe_avail()) {           // if there's a frame from the Wheelwriter...
+          frame = get_WWframe();
+          if (capture_state == CAPTURE_ON || capture_state == CAPTURE_ARMED) { // capturing, save its words for later...
+             WWtime = frame->time;
+             for (i = 0; i < frame->count && capture_state != CAPTURE_OFF; i++) {
+                if (i) WWtime += frame->gap[i-1];
+                if (!capture_put(ww_frame_word(frame,i),WWtime)) {
+                   printf("\r\n");
+                   capture_status();    // full, or everything after the trigger is in
+                }
+             }
+          }
+          else if (capture_state == CAPTURE_OFF) { // ...otherwise send it to the console now
+             parseWWframe(frame);
+          }
+          if (capture_state == CAPTURE_DUMP)
+             drop_WWframe();                       // frames that arrive during a dump are discarded, and counted as dropped
+          else
+             release_WWframe();
+	   }
+       else if (current_mode() == MODE_BINARY && !tx0_count()) { // binary mode, the BUS and the console have both gone quiet...
+          bin_flush();                  // send whatever words are waiting
        }
 
-	   if (WWdata_avail()) {            // if there's data from the Wheelwriter...
-          parseWWdata(get_WWdata());
-	   }
+       if (capture_state == CAPTURE_DUMP && tx0_free() >= 16) { // dumping the capture and there's room to send...
+          if (capture_get(&WWdata,&WWtime))
+             parseWWdata(WWdata,WWtime); // ...send the next word the same way as a live one
+       }
+
+       tx1_service();                   // keep words going out on the BUS
+
+       if (printing)
+          printer_poll();               // type the text from the console on the typewriter...
+       else
+          poll_console();               // ...or handle commands typed on the console
+
+       if (!tickcount) {                // every second...
+          tickcount = 20;
+          if (stats_countdown) --stats_countdown;
+          if (!stats_countdown && current_mode() == MODE_STATS) {
+             print_summary();           // stats mode, a summary every stats_seconds or SUMMARY_SECONDS
+          }
+          else if (!stats_countdown && current_mode() != MODE_BINARY) {
+             if (stats_seconds) {       // statistics reports turned on from the console...
+                stats_countdown = stats_seconds;
+                print_stats();
+             }
+             else if (!switch2) {       // if switch 2 is on (debug mode), every 10 seconds...
+                stats_countdown = 10;
+                print_stats();
+             }
+          }
+       }
+
+       if (!WWframe_avail() && !(printing ? printer_ready() : char_avail()) && !tx1_count() && capture_state != CAPTURE_DUMP) { // nothing waiting...
+          idle_start = micros();
+          hal_idle();                   // ...sleep until the next interrupt
+          idle_us += micros() - idle_start;
+       }
 	}
 }
 
@@ -0,0 +1,119 @@
+// Page reconstruction for page mode.
+//
+// ASCII mode sends every keystroke as it happens, corrections and all. Page mode instead
+// follows the carrier, in microspaces from the left margin, and the paper, in microlines,
+// and types each character into a copy of the line in MOVX SRAM at the column the carrier
+// is over. Erasing a character blanks its column and a character struck over another one
+// replaces it, except that an underscore doesn't hide the character it underlines. The
+// line is sent to the console only when the paper moves up a whole line, so what comes
+// out is the page as it was typed, without the backspaces and retyping that went into it.
+//
+// The left margin is where the carrier was when page mode started. Moving left of it
+// makes that the new left margin. Columns are counted in the pitch set by the "pitch"
+// command, and characters beyond PAGEWIDTH columns are lost.
+
+#include <stdio.h>
+#include "hal.h"
+#include "wwproto.h"
+#include "reader.h"
+#include "page.h"
+
+#define SPACE      0x20
+#define UNDERSCORE 0x5F
+
+// kept across a watchdog reset, see page_resume()
+static char xdata NOINIT line[PAGEWIDTH];       // the line being typed
+static unsigned char xdata NOINIT linelen;      // columns used in line[]
+static int xdata NOINIT carrier;                // microspaces from the left margin
+static int xdata NOINIT paper;                  // microlines the paper has moved up since the line was started
+
+//------------------------------------------------------------------------------------------
+// returns the column the carrier is over.
+//------------------------------------------------------------------------------------------
+static unsigned int column(void) {
+    unsigned char pitch = microSpacesPerCharacter;
+
+    return ((carrier + pitch/2) / pitch);
+}
+
+//------------------------------------------------------------------------------------------
+// puts 'c' into the line at the carrier, for a character or, with 'c' = SPACE, an erase.
+//------------------------------------------------------------------------------------------
+static void strike(char c) {
+    unsigned int col = column();
+
+    if (col >= PAGEWIDTH) return;       // off the end of the line
+    if (c == UNDERSCORE && col < linelen && line[col] != SPACE) return;
+    while (linelen <= col)
+       line[linelen++] = SPACE;
+    line[col] = c;
+}
+
+//------------------------------------------------------------------------------------------
+// forgets the line and puts the carrier at the left margin.
+//------------------------------------------------------------------------------------------
+void page_init(void) {
+    linelen = 0;
+    carrier = 0;
+    paper = 0;
+}
+
+//------------------------------------------------------------------------------------------
+// after a watchdog reset, carries on with the line that was being typed. returns FALSE if
+// what is left of it doesn't make sense, and page_init() must be called instead.
+//------------------------------------------------------------------------------------------
+bit page_resume(void) {
+    return (linelen <= PAGEWIDTH);
+}
+
+//------------------------------------------------------------------------------------------
+// sends the line to the console, without trailing spaces, and starts a new one.
+//------------------------------------------------------------------------------------------
+void page_flush(void) {
+    unsigned char i;
+
+    while (linelen && line[linelen-1] == SPACE)
+       --linelen;
+    for (i = 0; i < linelen; i++)
+       putchar(line[i]);
+    putchar('\r');
+    putchar('\n');
+    linelen = 0;
+}
+
+//------------------------------------------------------------------------------------------
+// applies a command just completed by ww_decode() to the line.
+//------------------------------------------------------------------------------------------
+void page_command(ww_decoder xdata *d) {
+    unsigned int distance;
+
+    switch (d->action) {
+        case ACT_CHARACTER:             // 0x121,0x003,printwheel code,microspaces
+            if (d->arg[0] && d->arg[0] <= sizeof(printwheel))
+               strike(printwheel[d->arg[0]-1]);
+            carrier += d->arg[1];       // printwheel code 0 is SPACE, which only moves the carrier
+            break;
+        case ACT_ERASE:                 // 0x121,0x004,printwheel code,microspaces
+            strike(SPACE);              // the character is erased where it is, the carrier stays put
+            break;
+        case ACT_VERTICAL:              // 0x121,0x005,direction and microlines
+            if (d->arg[0] & 0x80) {     // paper up...
+               paper += d->arg[0] & 0x1F;
+               while (paper >= LINESPACING) {           // ...the line is finished
+                  page_flush();
+                  paper -= LINESPACING;
+               }
+            }
+            else                        // paper down, half lines for sub and superscripts stay in the same line
+               paper -= d->arg[0] & 0x1F;
+            break;
+        case ACT_HORIZONTAL:            // 0x121,0x006,direction and microspaces high bits,microspaces low bits
+            distance = ((unsigned int)(d->arg[0]&0x7F)<<8)|d->arg[1];
+            if (d->arg[0] & 0x80)
+               carrier += distance;
+            else
+               carrier -= distance;
+            if (carrier < 0) carrier = 0;               // left of the left margin, that's the new one
+            break;
+    }
+}
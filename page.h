@@ -0,0 +1,13 @@
+// Page reconstruction for page mode. See page.c.
+
+#ifndef PAGE_H
+#define PAGE_H
+
+#define PAGEWIDTH 132                   // columns kept for the line being typed
+
+void page_init(void);
+bit page_resume(void);
+void page_command(ww_decoder xdata *d);
+void page_flush(void);
+
+#endif
@@ -0,0 +1,123 @@
+// Print mode: the typewriter as a printer.
+//
+// The "print" console command makes the text that follows on the console go to the
+// Printer Board instead of to the command line, until Ctrl-D. Each character is looked up
+// in ascii_printwheel[] and sent as the same 0x121,0x003,printwheel code,microspaces
+// command the Function Board sends for a key, advancing the carrier by the pitch set by
+// the "pitch" command. A character that isn't on the printwheel is typed as a space so
+// the columns still line up. LF returns the carrier to the left margin and moves the
+// paper up a line, CR only returns the carrier, so text with either line ending comes out
+// right, TAB moves the carrier to the next multiple of TABCOLUMNS columns and BS moves it
+// back one column.
+//
+// The commands are put in the serial 1 transmit buffer whenever there is room for a whole
+// one, and serial1_isr() sends each word as soon as the one before has been acknowledged,
+// so the Printer Board never waits on the main loop. The text waits in the serial 0
+// receive buffer in the meantime, with XON/XOFF holding off the sender when that fills up.
+
+#include <stdio.h>
+#include "hal.h"
+#include "wwproto.h"
+#include "uart12.h"
+#include "reader.h"
+#include "printer.h"
+
+#define CR    0x0D
+#define LF    0x0A
+#define BS    0x08
+#define TAB   0x09
+#define EOT   0x04                      // Ctrl-D
+
+#define FALSE 0
+#define TRUE  1
+
+#define TABCOLUMNS 8                    // columns between tab stops
+#define MAXWORDS   7                    // most BUS words sent for one character, LF with the carrier away from the margin
+
+bit printing = FALSE;                   // text from the console goes to the Printer Board
+static unsigned int xdata carrier;      // microspaces from the left margin
+static unsigned long xdata printed;     // characters typed since "print"
+
+//------------------------------------------------------------------------------------------
+// sends the command to move the carrier 'distance' microspaces, to the right if 'right'.
+//------------------------------------------------------------------------------------------
+static void move(unsigned int distance, bit right) {
+    send_WWdata(WWADDRESS);
+    send_WWdata(0x006);
+    send_WWdata((right ? 0x80 : 0x00)|((distance>>8)&0x7F));
+    send_WWdata(distance&0xFF);
+}
+
+//------------------------------------------------------------------------------------------
+// sends the commands for character 'c', which the serial 1 transmit buffer has room for.
+//------------------------------------------------------------------------------------------
+static void type(char c) {
+    unsigned char pitch = microSpacesPerCharacter;
+    unsigned int distance;
+
+    if (c >= ' ' && c <= '~') {         // printwheel character or SPACE
+       send_WWdata(WWADDRESS);
+       send_WWdata(0x003);
+       send_WWdata(ascii_printwheel[c-' ']);
+       send_WWdata(pitch);
+       carrier += pitch;
+       ++printed;
+    }
+    else if (c == LF || c == CR) {
+       if (carrier) {                   // carrier return
+          move(carrier,FALSE);
+          carrier = 0;
+       }
+       if (c == LF) {                   // paper up one line
+          send_WWdata(WWADDRESS);
+          send_WWdata(0x005);
+          send_WWdata(0x80|LINESPACING);
+       }
+    }
+    else if (c == TAB) {
+       distance = TABCOLUMNS*pitch - carrier%(TABCOLUMNS*pitch);
+       move(distance,TRUE);
+       carrier += distance;
+    }
+    else if (c == BS && carrier >= pitch) {
+       move(pitch,FALSE);
+       carrier -= pitch;
+    }                                   // other control characters are ignored
+}
+
+//------------------------------------------------------------------------------------------
+// starts print mode with the carrier taken to be at the left margin.
+//------------------------------------------------------------------------------------------
+void printer_start(void) {
+    printf("printing, Ctrl-D to stop\r\n");
+    carrier = 0;
+    printed = 0;
+    printing = TRUE;
+    serial0_flow(TRUE);
+}
+
+//------------------------------------------------------------------------------------------
+// returns TRUE if there is text waiting that can be sent to the Printer Board now.
+//------------------------------------------------------------------------------------------
+bit printer_ready(void) {
+    return (char_avail() && tx1_free() >= MAXWORDS);
+}
+
+//------------------------------------------------------------------------------------------
+// sends as much of the text waiting on the console to the Printer Board as the serial 1
+// transmit buffer has room for, and leaves print mode at Ctrl-D. returns without waiting.
+//------------------------------------------------------------------------------------------
+void printer_poll(void) {
+    char c;
+
+    while (printing && printer_ready()) {
+       c = getchar();
+       if (c == EOT) {
+          printing = FALSE;
+          serial0_flow(FALSE);
+          printf("\r\n%lu characters printed\r\n",printed);
+       }
+       else
+          type(c);
+    }
+}
@@ -0,0 +1,7 @@
+// printer.c function prototypes...
+
+void printer_start(void);
+bit printer_ready(void);
+void printer_poll(void);
+
+extern bit printing;                    // TRUE in print mode, see printer.c
@@ -0,0 +1,29 @@
+// main.c settings and functions shared with the other modules...
+
+#define FIFTEENPITCH 8                  // number of microspaces for each character on the 15P printwheel
+#define TWELVEPITCH 10                  // number of microspaces for each character on the 12P printwheel
+#define TENPITCH 12                     // number of microspaces for each character on the 10P printwheel
+#define LINESPACING 16                  // number of microlines for one line on the 10P, 12P and PS printwheels
+
+#define MODE_SWITCHES 0                 // output mode selected by switches 1 and 4
+#define MODE_ASCII    1
+#define MODE_HEX      2
+#define MODE_BINARY   3
+#define MODE_PAGE     4                 // only from the console
+#define MODE_STATS    5                 // only from the console
+
+#define SETTING_OFF      0              // timestamps setting
+#define SETTING_ON       1
+#define SETTING_SWITCHES 2              // follow switch 2 (debug mode)
+
+extern unsigned char output_mode;       // one of MODE_xxx
+extern unsigned char timestamps;        // one of SETTING_xxx
+extern unsigned char stats_seconds;     // seconds between statistics reports, 0 = only in debug mode
+extern unsigned char microSpacesPerCharacter;
+extern volatile bit alive;              // set while the main loop keeps coming around, see Timer0_ISR()
+
+unsigned char current_mode(void);
+bit timestamps_on(void);
+void print_stats(void);
+void clear_stats(void);
+void clear_summary(void);
@@ -0,0 +1,58 @@
+//************************************************************************//
+//                                                                        //
+//            For use with 12MHZ or 6MHZ crystal, see clock.h             //
+//                                                                        //
+//************************************************************************//
+
+// Free-running microsecond clock. Timer 2 runs in 16 bit auto-reload mode with a reload
+// value of zero, clocked at OSC/12 = 1 MHz, and Timer2_ISR() counts its overflows to
+// extend it to 32 bits. The count wraps around after about 71 minutes. With a 6 MHz
+// crystal timer 2 counts every 2 microseconds and the count is doubled, see clock.h.
+
+#include "hal.h"
+#include "clock.h"
+
+volatile unsigned int t2_overflows;     // upper 16 bits of the microsecond count
+
+// ======================= timer2 ISR =======================
+// every 65.536 milliseconds at 12 MHz
+// ==========================================================
+void Timer2_ISR() INTERRUPT(5) {
+    TF2 = 0;                            // timer 2 overflow flag is not cleared by hardware
+    ++t2_overflows;
+}
+
+//------------------------------------------------------------
+// initialize timer 2 as a free-running FOSC/12 counter
+//------------------------------------------------------------
+void init_timer2(void) {
+    t2_overflows = 0;
+    T2CON = 0x00;                       // 16 bit auto-reload, timer stopped
+    RCAP2H = 0;                         // reload with zero, so count through all 65536 values
+    RCAP2L = 0;
+    TH2 = 0;
+    TL2 = 0;
+    ET2 = 1;                            // enable timer 2 interrupt
+    EA = 1;                             // global interrupt enable
+    TR2 = 1;                            // run timer 2
+}
+
+//------------------------------------------------------------
+// returns microseconds since init_timer2(). serial1_isr() reads
+// the clock itself since this function isn't reentrant.
+//------------------------------------------------------------
+unsigned long micros(void) {
+    unsigned char hi,lo;
+    unsigned int overflows;
+
+    ET2 = 0;                            // keep Timer2_ISR() from changing t2_overflows
+    do {
+       hi = TH2;
+       lo = TL2;
+    } while (hi != TH2);                // read again if TL2 rolled over into TH2
+    overflows = t2_overflows;
+    if (TF2 && !(hi & 0x80))            // overflowed after the ISR was held off but before TH2 was read
+       ++overflows;
+    ET2 = 1;
+    return ((((unsigned long)overflows<<16)|((unsigned int)hi<<8)|lo)*TIMER_US);
+}
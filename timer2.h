@@ -0,0 +1,21 @@
+// timer2.c function prototypes...
+void init_timer2(void);
+unsigned long micros(void);
+
+extern volatile unsigned int t2_overflows; // upper 16 bits of the microsecond count, kept by Timer2_ISR()
+
+// reads the microsecond clock into 'now' in an interrupt routine, which can't call micros()
+// since it isn't reentrant. Timer2_ISR() can't interrupt it, so an overflow Timer2_ISR()
+// hasn't got to yet is counted here. TH2 is read again if TL2 rolled over into it. needs
+// clock.h.
+#define ISR_MICROS(now) {                                                          \
+    unsigned char th_,tl_;                                                         \
+    unsigned int overflows_;                                                       \
+    do {                                                                           \
+       th_ = TH2;                                                                  \
+       tl_ = TL2;                                                                  \
+    } while (th_ != TH2);                                                          \
+    overflows_ = t2_overflows;                                                     \
+    if (TF2 && !(th_ & 0x80)) ++overflows_;                                        \
+    (now) = (((unsigned long)overflows_<<16)|((unsigned int)th_<<8)|tl_)*TIMER_US; \
+}
@@ -0,0 +1,65 @@
+// Capture trigger.
+//
+// Set with the "trigger" console command, the trigger is a sequence of up to TRIGSTEPS
+// word patterns that must match consecutive BUS words. Each pattern is a word and a mask,
+// and a word matches if it has the same bits as the pattern wherever the mask has a one:
+// "004" is the word 0x004, "080/180" any word with bit 8 clear and bit 7 set, and
+// "x" any word at all. "trigger 121 004" fires on every erase command.
+//
+// The patterns are tried together rather than one after the other: bit i of 'matched'
+// is set while the last i+1 words have matched the first i+1 patterns, so each word costs
+// one comparison per pattern and no match is missed where two could overlap. With a
+// trigger set, "capture start" keeps the commands that come before it in the capture
+// buffer until it fires, see capture_put().
+
+#include <stdio.h>
+#include "hal.h"
+#include "trigger.h"
+
+unsigned int xdata trigger_value[TRIGSTEPS];    // pattern for each word of the sequence...
+unsigned int xdata trigger_mask[TRIGSTEPS];     // ...and the bits of it that must match
+unsigned char trigger_steps = 0;        // words in the sequence, 0 = no trigger
+unsigned char trigger_pre = 0;          // commands kept from before the one that fires the trigger
+unsigned char trigger_post = 0;         // commands captured after it
+static unsigned char matched;           // bit i: the last i+1 words matched patterns 0 to i
+
+//------------------------------------------------------------------------------------------
+// forgets the words seen so far, so the whole sequence has to come again.
+//------------------------------------------------------------------------------------------
+void trigger_arm(void) {
+    matched = 0;
+}
+
+//------------------------------------------------------------------------------------------
+// takes the next word from the BUS. returns TRUE if it completes the sequence.
+//------------------------------------------------------------------------------------------
+bit trigger_match(unsigned int w) {
+    unsigned char i,hits = 0;
+
+    for (i = 0; i < trigger_steps; i++) {
+       if ((w & trigger_mask[i]) == trigger_value[i])
+          hits |= 1 << i;
+    }
+    matched = ((matched << 1) | 1) & hits;
+    return (trigger_steps && (matched & (1 << (trigger_steps-1))));
+}
+
+//------------------------------------------------------------------------------------------
+// prints the trigger settings.
+//------------------------------------------------------------------------------------------
+void trigger_status(void) {
+    unsigned char i;
+
+    printf("trigger");
+    if (!trigger_steps)
+       printf(" off");
+    for (i = 0; i < trigger_steps; i++) {
+       if (!trigger_mask[i])
+          printf(" x");
+       else if (trigger_mask[i] == 0x1FF)
+          printf(" %03X",trigger_value[i]);
+       else
+          printf(" %03X/%03X",trigger_value[i],trigger_mask[i]);
+    }
+    printf(", pre %u, post %u\r\n",(unsigned int)trigger_pre,(unsigned int)trigger_post);
+}
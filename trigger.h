@@ -0,0 +1,13 @@
+// trigger.c function prototypes...
+
+#define TRIGSTEPS 4                     // most words in a trigger sequence
+
+void trigger_arm(void);
+bit trigger_match(unsigned int w);
+void trigger_status(void);
+
+extern unsigned int xdata trigger_value[TRIGSTEPS];
+extern unsigned int xdata trigger_mask[TRIGSTEPS];
+extern unsigned char trigger_steps;     // words in the sequence, 0 = no trigger
+extern unsigned char trigger_pre;       // commands kept from before the trigger
+extern unsigned char trigger_post;      // commands captured after it
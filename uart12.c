@@ -1,76 +1,146 @@
 //************************************************************************//
 //                                                                        //
-//                       For use with 12MHZ crystal                       //
+//            For use with 12MHZ or 6MHZ crystal, see clock.h             //
 //                                                                        //
 //************************************************************************//
 
 // Interrupt driven serial 0 and serial 1 functions.
 // Both serial 0 (for the console) and serial 1 (for the Wheelwriter) use 
-// receive buffers in internal MOVX SRAM. Serial 0 in mode 1 uses timer 1 
+// receive buffers in internal MOVX SRAM. Serial 0 also has a transmit buffer
+// in MOVX SRAM that is emptied by the serial 0 interrupt so that putchar() and
+// printf() return without waiting for each character to be sent. Serial 1
+// gathers the words from the BUS into frames of one command each, and each
+// frame is stamped with the timer 2 microsecond clock (see timer2.c), which
+// must be running. Serial 0 in mode 1 uses timer 1 
 // for baud rate generation. Serial 1 in mode 2 uses the system clock for 
 // baud rate generation. init_serial0() and init_serial1() must be called 
-// before using UARTs. No syntax error handling. No handshaking.
+// before using UARTs. No syntax error handling. Serial 0 has XON/XOFF flow
+// control for text sent to be typed, see serial0_flow().
 
-#include <reg420.h>
+#include "hal.h"
+#include "clock.h"
+#include "timer2.h"
+#include "wwproto.h"
+#include "uart12.h"
+#include "reader.h"
 
 #define FALSE 0
 #define TRUE  1
 
 //////////////////////////////////////// Serial 0 /////////////////////////////////////
-#define RBUFSIZE0 256							// size of the receive buffer in bytes
+#define RBUFSIZE0 64							// size of the receive buffer in bytes, a power of 2 up to 256
 
 volatile unsigned char rx0_head;  	    	    // receive interrupt index for serial 0
 volatile unsigned char rx0_tail;  	    	    // receive read index for serial 0
 volatile unsigned char xdata rx0_buf[RBUFSIZE0]; // receive buffer for serial 0 in internal MOVX RAM
-volatile bit tx0_ready;
+unsigned char rx0_hiwater;                      // most characters ever waiting in the receive buffer
+unsigned int xdata rx0_dropped;                 // characters lost because the receive buffer was full
+#define XON  0x11
+#define XOFF 0x13
+#define RX0_XOFF (RBUFSIZE0-16)                 // characters waiting when XOFF is sent, leaving room for what's on its way
+#define RX0_XON  8                              // characters waiting when XON is sent
+volatile bit rx0_flow;                          // XON/XOFF flow control is on
+volatile bit rx0_stopped;                       // XOFF has been sent and XON hasn't
+volatile unsigned char rx0_xchar;               // XON or XOFF to send ahead of the transmit buffer, 0 = none
+
+#define TBUFSIZE0 128							// size of the transmit buffer in bytes
+volatile unsigned char tx0_head;  	    	    // transmit write index for serial 0
+volatile unsigned char tx0_tail;  	    	    // transmit interrupt index for serial 0
+volatile unsigned char xdata tx0_buf[TBUFSIZE0]; // transmit buffer for serial 0 in internal MOVX RAM
+volatile bit tx0_busy;                          // set while the transmitter is draining the buffer
+unsigned char tx0_hiwater;                      // most characters ever waiting in the transmit buffer
+unsigned int xdata tx0_stalls;                  // number of times putchar() had to wait for a full buffer
 
 // ---------------------------------------------------------------------------
 // Serial 0 interrupt service routine
 // ---------------------------------------------------------------------------
-void serial0_isr(void) interrupt 4 using 2 {
+void serial0_isr(void) INTERRUPT(4) USING(2) {
+   unsigned char c,next;
+
    // serial 0 transmit interrupt
    if (TI) {                                        // transmit interrupt?
 	   TI = FALSE;                                  // clear transmit interrupt flag
-	   tx0_ready = TRUE;							// transmit buffer is ready for a new character
+       if (rx0_xchar) {                             // XON or XOFF goes first
+          SBUF0 = rx0_xchar;
+          rx0_xchar = 0;
+       }
+       else if (tx0_tail != tx0_head) {             // more characters waiting in the transmit buffer?
+          SBUF0 = tx0_buf[tx0_tail];                // send the next one
+	      if (++tx0_tail == TBUFSIZE0) tx0_tail = 0;
+       }
+       else
+          tx0_busy = FALSE;                         // buffer is empty, transmitter goes idle
     }
 
     // serial 0 receive interrupt
     if(RI) {                                	    // serial 0 Receive character?
         RI = 0;                             	    // clear serial receive interrupt flag
-        rx0_buf[rx0_head] = SBUF0;              	// Get character from serial port and put into serial 0 fifo.
-		if (++rx0_head == RBUFSIZE0) rx0_head = 0;	// wrap pointer around to the beginning
+        c = SBUF0;                                  // Get character from serial port
+        next = rx0_head+1;
+        if (next == RBUFSIZE0) next = 0;            // wrap pointer around to the beginning
+        if (next == rx0_tail) {                     // serial 0 fifo full, the character is lost
+           ++rx0_dropped;
+        }
+        else {
+           rx0_buf[rx0_head] = c;                   // and put into serial 0 fifo.
+           rx0_head = next;
+           next = (rx0_head-rx0_tail) & (RBUFSIZE0-1); // characters now waiting
+           if (next > rx0_hiwater) rx0_hiwater = next;
+           if (rx0_flow && !rx0_stopped && next >= RX0_XOFF) { // filling up, ask the sender to stop
+              rx0_stopped = TRUE;
+              rx0_xchar = XOFF;
+              if (!tx0_busy) {
+                 tx0_busy = TRUE;
+                 TI = TRUE;                         // interrupt again to send it
+              }
+           }
+        }
     }
 }
 
 // ---------------------------------------------------------------------------
 //  Initialize serial 0 for mode 1, standard full-duplex asynchronous communication, 
-//  using timer 1 for baud rate generation.
+//  using timer 1 for baud rate generation. Any rate the console offers, see baudrates[] in
+//  console.c, otherwise 9600 bps.
 // ---------------------------------------------------------------------------
+#define SET_BAUD(baud) do {                                                        \
+    TH1 = BAUD_TH1(baud);                                                          \
+    if (BAUD_SMOD(baud)) PCON |= 0x80; else PCON &= 0x7F;                          \
+} while (0)
+
 void init_serial0(unsigned int baudrate) {
     rx0_head = 0;                   		// initialize head/tail pointers.
     rx0_tail = 0;
+    tx0_head = 0;
+    tx0_tail = 0;
+    tx0_busy = TRUE;                        // TI set below starts the transmitter, which then goes idle
+    rx0_flow = FALSE;
+    rx0_stopped = FALSE;
+    rx0_xchar = 0;
 
     SCON0 = 0x50;                  			// Serial 0 for mode 1.
     TMOD = (TMOD & 0x0F) | 0x20;   			// Timer 1, mode 2, 8-bit reload.
 	CKMOD |= 0x10;				   			// Make timer 1 clocked by OSC/1 instead of the default OSC/12
-    switch (baudrate) {                     // for 12MHz clock...
+    switch (baudrate) {                     // reloads for FOSC, see clock.h
         case 28800:
-            TH1 = 0xF3;                     // 28800 bps
+            SET_BAUD(28800);
             break;
         case 14400:
-            TH1 = 0xE6;                     // 14400 bps
-            break;
-        case 9600:
-            TH1 = 0xD9;                     // 9600 bps
+            SET_BAUD(14400);
             break;
         case 4800:
-            TH1 = 0xB2;                     // 4800 bps
+            SET_BAUD(4800);
             break;
         case 2400:
-            TH1 = 0x64;                     // 2400 bps
+            SET_BAUD(2400);
+            break;
+#if BAUD_OK(57600)
+        case 57600:
+            SET_BAUD(57600);
             break;
+#endif
         default:
-            TH1 = 0xD9;                     // 9600 bps
+            SET_BAUD(9600);
     }
 
     TR1 = TRUE;                    			// Run timer 1.
@@ -88,6 +158,35 @@ char char_avail(void) {
    return (rx0_head != rx0_tail);
 }
 
+// ---------------------------------------------------------------------------
+// sends XON or XOFF ahead of whatever is in the serial 0 transmit buffer.
+// ---------------------------------------------------------------------------
+static void rx0_send_xchar(unsigned char c) {
+    ES0 = FALSE;
+    rx0_xchar = c;
+    if (!tx0_busy) {                            // if the transmitter is idle...
+       tx0_busy = TRUE;
+       TI = TRUE;                               // ...the transmit interrupt will send it
+    }
+    ES0 = TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// turns XON/XOFF flow control for the characters received on serial 0 on or off.
+// while it's on, XOFF is sent when the receive buffer is three quarters full and
+// XON once getchar() has emptied it again, so text can be sent faster than it's
+// taken without losing any.
+// ---------------------------------------------------------------------------
+void serial0_flow(bit on) {
+    ES0 = FALSE;
+    rx0_flow = on;
+    ES0 = TRUE;
+    if (!on && rx0_stopped) {                   // don't leave the sender waiting
+       rx0_stopped = FALSE;
+       rx0_send_xchar(XON);
+    }
+}
+
 //-----------------------------------------------------------
 // waits until a character is available in the serial 0 receive
 // buffer. returns the character. does not echo the character.
@@ -95,64 +194,261 @@ char char_avail(void) {
 char getchar(void) {
     unsigned char buf;
 
-    while (rx0_head == rx0_tail);     			// wait until a character is available
+    while (rx0_head == rx0_tail) hal_poll();	// wait until a character is available
     buf = rx0_buf[rx0_tail];
 	if (++rx0_tail == RBUFSIZE0) rx0_tail = 0; 
+    if (rx0_stopped && ((rx0_head-rx0_tail) & (RBUFSIZE0-1)) <= RX0_XON) {
+       rx0_stopped = FALSE;                     // room again, let the sender carry on
+       rx0_send_xchar(XON);
+    }
     return(buf);
 }
 
 // ---------------------------------------------------------------------------
-// sends one character out to serial 0.
+// returns the number of characters waiting in the serial 0 transmit buffer
+// ---------------------------------------------------------------------------
+unsigned char tx0_count(void) {
+    unsigned char head = tx0_head;              // tx0_head only changes here in the foreground
+
+    if (head >= tx0_tail)
+       return (head - tx0_tail);
+    return (TBUFSIZE0 - tx0_tail + head);
+}
+
+// ---------------------------------------------------------------------------
+// returns the number of characters that can be added to the serial 0 transmit
+// buffer without waiting.
+// ---------------------------------------------------------------------------
+unsigned char tx0_free(void) {
+   return ((TBUFSIZE0-1) - tx0_count());       // one slot is always left empty
+}
+
+// ---------------------------------------------------------------------------
+// puts one character into the serial 0 transmit buffer and starts the transmitter
+// if it is idle. the caller has already made sure there is room in the buffer.
+// ---------------------------------------------------------------------------
+static void tx0_put(char c) {
+    unsigned char waiting;
+
+    tx0_buf[tx0_head] = c;
+    ES0 = FALSE;                                // keep serial0_isr() out while the indexes change
+	if (++tx0_head == TBUFSIZE0) tx0_head = 0;
+    if (!tx0_busy) {                            // if the transmitter is idle...
+       tx0_busy = TRUE;
+       TI = TRUE;                               // ...the transmit interrupt will send the character
+    }
+    ES0 = TRUE;
+    waiting = tx0_count();
+    if (waiting > tx0_hiwater) tx0_hiwater = waiting;
+}
+
+// ---------------------------------------------------------------------------
+// sends one character out to serial 0. the character is queued in the transmit
+// buffer and returns immediately. only waits if the transmit buffer is full, for
+// as long as serial0_isr() takes to send a character. output of a second or more
+// at a slow baud rate waits longer than the watchdog allows, so each character
+// sent counts as the main loop coming around.
 // ---------------------------------------------------------------------------
 char putchar(char c)  {
-   while (!tx0_ready);          // wait here for transmit ready
-   SBUF0 = c;
-   tx0_ready = 0;
+   if (!tx0_free()) {                           // transmit buffer full?
+      ++tx0_stalls;
+      while (!tx0_free()) hal_poll();           // wait here for serial0_isr() to make room
+      alive = 1;                                // it did, so the main loop isn't stuck
+   }
+   tx0_put(c);
    return (c);
 }
 
+// ---------------------------------------------------------------------------
+// waits until everything in the serial 0 transmit buffer has been sent.
+// ---------------------------------------------------------------------------
+void flush_serial0(void) {
+   while (tx0_busy) hal_poll();                 // serial0_isr() clears tx0_busy after the last character
+}
+
+// ---------------------------------------------------------------------------
+// queues up to 'len' characters from 'buf' for serial 0 without waiting. returns
+// the number of characters actually queued, which is less than 'len' if the
+// transmit buffer fills up.
+// ---------------------------------------------------------------------------
+unsigned char write_serial0(char *buf, unsigned char len) {
+    unsigned char n,room;
+
+    room = tx0_free();
+    if (len > room) len = room;
+    for (n = 0; n < len; n++)
+       tx0_put(buf[n]);
+    return (len);
+}
+
 ///////////////////////////// Serial 1 interface to Wheelwriter ////////////////////////////
-#define RBUFSIZE1 32                            // receive buffer for 32 integers (64 bytes)
-volatile unsigned char data rx1_head;       	// receive interrupt index for serial 1
-volatile unsigned char data rx1_tail;       	// receive read index for serial 1
-volatile unsigned int xdata rx1_buf[RBUFSIZE1]; // receive buffer for serial 1 in internal MOVX RAM
-volatile bit tx1_ready;                         // set when ready to transmit
-sbit WWbus = P1^2;		  			            // P1.2, (RXD1, pin 3) used to monitor the Wheelwriter BUS
+#define RFRAMES1 8                              // receive buffer for 8 frames (176 bytes), must be a power of 2
+#define RX1_COMMAND 0xFE                        // rx1_want: the command word is next
+#define RX1_SIGNATURE 0x5AA5                    // rx1_signature once the receive buffer has been set up
+
+// the receive buffer and the state of the frame being assembled are kept in MOVX SRAM that
+// isn't cleared by a reset, so that after a watchdog reset init_serial1() can carry on with
+// the frames that were waiting instead of losing them.
+volatile unsigned char xdata NOINIT rx1_head;   // frame being assembled by serial1_isr()
+volatile unsigned char xdata NOINIT rx1_tail;   // frame returned by get_WWframe()
+ww_frame xdata NOINIT rx1_frames[RFRAMES1];     // receive buffer for serial 1 in internal MOVX RAM
+volatile unsigned char xdata NOINIT rx1_open;   // rx1_frames[rx1_head] has words and isn't finished
+unsigned char xdata NOINIT rx1_busy;            // the main loop is decoding rx1_frames[rx1_tail]
+unsigned char xdata NOINIT rx1_want;            // argument words still to come, WWARGS_ANY, RX1_COMMAND or 0 when none
+unsigned int xdata NOINIT rx1_signature;        // RX1_SIGNATURE if the above are worth keeping
+volatile bit rx1_quiet;                         // no word since the last timer 0 tick
+bit rx1_expect_ack;                             // the word before needs an acknowledge
+unsigned long data rx1_last;                    // arrival time of the word before
 volatile bit waitingForAcknowledge = 0;         // TRUE when expecting the acknowledge pulse from Wheelwriter
+bit ack_filter = TRUE;                          // TRUE to discard the acknowledge words
+volatile bit rx1_full;                          // the last word received was dropped because the buffer was full
+unsigned char rx1_hiwater;                      // most frames ever waiting in the receive buffer
+unsigned int xdata rx1_overruns;                // number of times the receive buffer filled up
+unsigned long xdata rx1_dropped;                // words lost because the receive buffer was full, or during a capture dump
+unsigned long xdata rx1_acks;                   // acknowledge words received
+unsigned int xdata rx1_noacks;                  // words that should have been acknowledged but weren't
+unsigned long xdata rx1_latency;                // most microseconds from a frame being finished to get_WWframe()
+unsigned long xdata rx1_closed;                 // when the frame before rx1_frames[rx1_head] was finished
+
+#define TBUFSIZE1 16                            // transmit buffer for 16 integers (32 bytes), must be a power of 2
+#define TX1_IDLE    0                           // transmit states: nothing on the BUS
+#define TX1_SENDING 1                           // the word at tx1_tail is being shifted out
+#define TX1_ACK     2                           // the word has gone, waiting for the acknowledge
+#define TX1_TIMEOUT 2                           // 50 millisecond ticks to wait for the acknowledge
+#define TX1_RETRIES 3                           // times a word is sent before giving up on it
+volatile unsigned char data tx1_head;           // send_WWdata() index for serial 1
+volatile unsigned char data tx1_tail;           // transmit index for serial 1, the word being sent
+volatile unsigned int xdata tx1_buf[TBUFSIZE1]; // transmit buffer for serial 1 in internal MOVX RAM
+volatile unsigned char data tx1_state;          // one of TX1_xxx
+volatile unsigned char data tx1_ticks;          // ticks left to wait for the acknowledge
+unsigned char tx1_tries;                        // times the word at tx1_tail has been sent
+unsigned long xdata tx1_sent;                   // words sent and acknowledged
+unsigned long xdata tx1_retries;                // words sent again because there was no acknowledge
+unsigned int xdata tx1_failed;                  // words given up on
 
 // ---------------------------------------------------------------------------
 // Serial 1 interrupt service routine
+//
+// Gathers the words from the BUS into frames, one command to a frame, so the main loop
+// deals with a command at a time instead of a word at a time (see ww_frame in wwproto.h).
+// Every word on the BUS is acknowledged by an all zeros word from the other board, so the
+// word after any other word is taken as its acknowledge if it's zero. An address word
+// starts a frame, and the frame is finished when its command has all the argument words
+// ww_cmdtable[] says it has. Anything else that isn't an acknowledge, such as the Printer
+// Board answering a command, goes in a WWFRAME_RESPONSE frame that lasts until the next
+// address word. rx1_tick() finishes a frame that has had no words for a timer 0 tick,
+// which closes the WWARGS_ANY commands and responses when the BUS goes quiet.
 // ---------------------------------------------------------------------------
-void serial1_isr(void) interrupt 7 using 3 {
+void serial1_isr(void) INTERRUPT(7) USING(3) {
 	unsigned int wwBusData;
-	static char count = 0;
+    unsigned char next,flags;
+    unsigned long now,gap;
+    ww_frame xdata *f;
+    bit ack,done;
 
     // serial 1 transmit interrupt
     if (TI1) {                                  // transmit interrupt?
 	   TI1 = FALSE;                             // clear transmit interrupt flag
-	   tx1_ready = TRUE;						// transmit buffer is ready for a new character
+       if (tx1_state == TX1_SENDING) {          // the word is out...
+          REN1 = TRUE;                          // enable reception
+          waitingForAcknowledge = TRUE;         // ...now wait for the acknowledge
+          tx1_ticks = TX1_TIMEOUT+1;            // the first tick may come right away
+          tx1_state = TX1_ACK;
+       }
     }
     
     //serial 1 receive interrupt
     if(RI1) {                                	// receive interrupt?
        RI1 = 0;                             	// clear receive interrupt flag
+       ISR_MICROS(now);                         // timestamp the word first thing
        wwBusData = SBUF1;                       // retrieve the lower 8 bits
        if (RB81) wwBusData |= 0x0100;           // ninth bit is in RB81
 
-       // discard the acknowledge pulse (all zeros)
-       if (waitingForAcknowledge) {             // just transmitted a command, waiting for acknowledge...
+       // the acknowledge pulse (all zeros)
+       if (waitingForAcknowledge) {             // just transmitted a word, waiting for acknowledge...
           waitingForAcknowledge = FALSE;        // clear the flag
-          if (wwBusData) {                      // if it's not acknowledge (all zeros) ...
-             rx1_buf[rx1_head] = wwBusData;     // save it in the buffer
-	         if (++rx1_head == RBUFSIZE1) rx1_head = 0;
+          rx1_expect_ack = TRUE;
+          if (tx1_state == TX1_ACK) {
+             tx1_ticks = 0;
+             tx1_state = TX1_IDLE;              // not acknowledged, tx1_service() sends it again
+             if (!wwBusData) {                  // acknowledged...
+                ++tx1_sent;
+                tx1_tries = 0;
+                tx1_tail = (tx1_tail+1) & (TBUFSIZE1-1);
+                if (tx1_tail != tx1_head && WWbus) { // ...send the next word straight away
+                   REN1 = FALSE;
+                   TB8_1 = (tx1_buf[tx1_tail] & 0x100) != 0;
+                   SBUF1 = tx1_buf[tx1_tail] & 0xFF;
+                   tx1_tries = 1;
+                   tx1_state = TX1_SENDING;
+                }
+             }
           }
 	   }
-       else {                                   // not waiting for acknowledge...
-          if (wwBusData == 0x121) count = 1; else ++count;
-	      if (wwBusData || (count%2)) {         // if wwBusData is not zero or if it's the second zero...
-             rx1_buf[rx1_head] = wwBusData;     // save it in the buffer
-	         if (++rx1_head == RBUFSIZE1) rx1_head = 0;
-	      }
+       ack = (rx1_expect_ack && !wwBusData);   // the word before this one needs an acknowledge...
+       if (ack)                                 // ...and this is it
+          ++rx1_acks;
+       else if (rx1_expect_ack)                 // ...but didn't get one, this is a word of its own
+          ++rx1_noacks;
+       rx1_expect_ack = !ack;                   // every word but an acknowledge is acknowledged
+
+       if (!ack || !ack_filter) {               // acknowledges are only kept when they're wanted
+          rx1_quiet = FALSE;
+          if (wwBusData & 0x100) {              // an address word finishes the frame before...
+             if (rx1_open) {
+                rx1_closed = now;
+                rx1_head = (rx1_head+1) & (RFRAMES1-1);
+                rx1_open = FALSE;
+             }
+             rx1_want = (wwBusData == WWADDRESS) ? RX1_COMMAND : WWARGS_ANY;
+             flags = WWFRAME_ADDRESS;           // ...and starts a new one
+          }
+          else if (ack || !rx1_want)            // not part of a command
+             flags = WWFRAME_RESPONSE;
+          else                                  // the rest of a command that didn't fit in one frame
+             flags = 0;
+
+          f = &rx1_frames[rx1_head];
+          if (rx1_open) {                       // add to the frame
+             gap = now - rx1_last;
+             f->gap[f->count-1] = (gap > 0xFFFF) ? 0xFFFF : gap;
+          }
+          else {                                // start a frame
+             next = (rx1_head+1) & (RFRAMES1-1);
+             if (next == rx1_tail) {            // buffer full, the word is lost
+                if (!rx1_full) ++rx1_overruns;  // count each time the buffer fills up...
+                rx1_full = TRUE;
+                ++rx1_dropped;                  // ...and every word lost while it's full
+             }
+             else {
+                rx1_full = FALSE;
+                rx1_open = TRUE;
+                f->time = now;
+                f->flags = flags;
+                f->count = 0;
+                next = ((rx1_head-rx1_tail) & (RFRAMES1-1)) + 1; // frames now waiting, this one included
+                if (next > rx1_hiwater) rx1_hiwater = next;
+             }
+          }
+          if (rx1_open) {                       // save it in the frame
+             if (ack) f->flags |= WWFRAME_ACK(f->count);
+             f->w[f->count++] = wwBusData;
+          }
+          rx1_last = now;
+
+          done = FALSE;                         // follow the command even if its words are being dropped
+          if (!ack && !(wwBusData & 0x100) && rx1_want && rx1_want != WWARGS_ANY) {
+             if (rx1_want == RX1_COMMAND)       // the command word says how many arguments follow
+                rx1_want = ww_cmdtable[WWCMDINDEX(wwBusData)].args;
+             else
+                --rx1_want;
+             done = !rx1_want;                  // all of the command is here
+          }
+          if (rx1_open && (done || f->count == WWFRAMEWORDS)) {
+             rx1_closed = now;
+             rx1_head = (rx1_head+1) & (RFRAMES1-1);
+             rx1_open = FALSE;
+          }
        }
     }   
 }
@@ -164,14 +460,51 @@ void serial1_isr(void) interrupt 7 using 3 {
 //  it is stored in RB8 (SCON1.2). the baud rate for mode 2 is a function only of the oscillator
 //  frequency. It is either the oscillator input divided by 32 or 64 as programmed by the SMOD 
 //  doubler bit for the associated UART. The SMOD_1 baud-rate doubler bit for serial port 1 
-//  is located at WDCON.7. In this case, the SMOD_1 baud-rate doubler bit is zero. Thus, the
-//  12MHz clock divided by 64 gives a bit rate for serial 1 of 187500 bps.
+//  is located at WDCON.7. It is cleared for a 12MHz clock divided by 64, or set for a 6MHz
+//  clock divided by 32, either way a bit rate for serial 1 of 187500 bps (see clock.h).
+//
+//  With 'warm' set, after a watchdog reset, the frames waiting in the receive buffer are
+//  kept if the buffer checks out. The frame that was being assembled is finished with the
+//  words it has, since the words that came during the reset are gone, and the frame the
+//  main loop was decoding is dropped, in case it is what stopped the main loop. Returns
+//  the number of BUS words kept.
 // ---------------------------------------------------------------------------
-void init_serial1(void) {
-    rx1_head = 0;                   			// initialize serial 1 head/tail pointers.
-    rx1_tail = 0;
+unsigned int init_serial1(bit warm) {
+    unsigned char i;
+    unsigned int kept = 0;
 
-    SMOD_1 = FALSE;                             // SMOD_1=0 therefor Serial 1 baud rate is oscillator freq (12MHz) divided by 64 (187,500 bps)
+    if (warm && rx1_signature == RX1_SIGNATURE && rx1_head < RFRAMES1 && rx1_tail < RFRAMES1) {
+       if (rx1_busy && rx1_tail != rx1_head)
+          rx1_tail = (rx1_tail+1) & (RFRAMES1-1);
+       if (rx1_open && rx1_frames[rx1_head].count)
+          rx1_head = (rx1_head+1) & (RFRAMES1-1);
+       for (i = rx1_tail; i != rx1_head; i = (i+1) & (RFRAMES1-1)) {
+          if (!rx1_frames[i].count || rx1_frames[i].count > WWFRAMEWORDS) {
+             kept = 0;                          // no good after all
+             rx1_head = rx1_tail;
+             break;
+          }
+          kept += rx1_frames[i].count;
+       }
+    }
+    else {
+       rx1_head = 0;                   			// initialize serial 1 head/tail pointers.
+       rx1_tail = 0;
+       rx1_signature = RX1_SIGNATURE;
+    }
+    rx1_open = FALSE;
+    rx1_busy = FALSE;
+    rx1_closed = 0;                             // timer 2 starts again from zero
+    rx1_want = 0;                               // words before the first address word are responses
+    rx1_expect_ack = FALSE;
+    rx1_full = FALSE;
+    tx1_head = 0;
+    tx1_tail = 0;
+    tx1_state = TX1_IDLE;
+    tx1_ticks = 0;
+    tx1_tries = 0;
+
+    SMOD_1 = BUS_SMOD;                          // Serial 1 baud rate is oscillator freq divided by 64, or by 32 with SMOD_1=1 (187,500 bps)
     SM01 = TRUE;                                // SM01=1, SM11=0, SM21=0 sets serial mode 2
     SM11 = FALSE;
     SM21 = FALSE;
@@ -180,43 +513,197 @@ void init_serial1(void) {
     RI1  = FALSE;                   			// clear RI of SCON1 to Get Ready to Receive
     ES1 = TRUE;                    				// enable serial interrupt.
     EA = TRUE;                     				// enable global interrupt
+    return (kept);
 }
 
 // ---------------------------------------------------------------------------
-// sends an unsigned integer as 11 bits (start bit, 9 data bits, stop bit)
+// puts an unsigned integer in the serial 1 transmit buffer, to be sent as 11 bits (start
+// bit, 9 data bits, stop bit) without waiting. returns FALSE if the buffer is full.
 // ---------------------------------------------------------------------------
-void send_WWdata(unsigned int wwCommand) {
-   while (!tx1_ready);		 					// wait until transmit buffer is empty
-   tx1_ready = 0;                               // clear flag   
-   while(!WWbus);                               // wait until the Wheelwriter bus goes high
-   REN1 = FALSE;                                // disable reception
-   TB8_1 = (wwCommand & 0x100);                 // ninth bit
-   SBUF1 = wwCommand & 0xFF;                    // lower 8 bits
-   while(!tx1_ready);                           // wait until finished transmitting
-   REN1 = TRUE;                                 // enable reception
-   waitingForAcknowledge = TRUE;                // just transmitted a command, now waiting for acknowledge
-   while(!WWbus);                               // wait until the Wheelwriter bus goes high
-   while(WWbus);                                // wait until the Wheelwriter bus goes low (acknowledge)
-   while(!WWbus);                               // wait until the Wheelwriter bus goes high again
+bit send_WWdata(unsigned int wwCommand) {
+   unsigned char next;
+
+   next = (tx1_head+1) & (TBUFSIZE1-1);
+   if (next == tx1_tail) return (FALSE);        // transmit buffer full
+   tx1_buf[tx1_head] = wwCommand;
+   tx1_head = next;
+   tx1_service();                               // start sending if the BUS is free
+   return (TRUE);
 }
 
 // ---------------------------------------------------------------------------
-// returns 1 if there is an unsigned integer from the Wheelwriter waiting in the serial 1 receive buffer.
+// starts sending the next word in the serial 1 transmit buffer when the BUS is free.
+// once it is going, serial1_isr() sends each word as soon as the one before it has been
+// acknowledged, so this only has to get things started and deal with words that weren't
+// acknowledged. a word is sent up to TX1_RETRIES times; after that it, and the rest of
+// its command, is dropped. called from the main loop.
 // ---------------------------------------------------------------------------
-char WWdata_avail(void) {
+void tx1_service(void) {
+   ES1 = FALSE;
+   if (tx1_state == TX1_ACK && !tx1_ticks) {   // no acknowledge in time
+      waitingForAcknowledge = FALSE;
+      tx1_state = TX1_IDLE;
+   }
+   if (tx1_state == TX1_IDLE && tx1_tail != tx1_head && tx1_tries >= TX1_RETRIES) {
+      ++tx1_failed;                             // give up on this word...
+      do                                        // ...and on the rest of its command
+         tx1_tail = (tx1_tail+1) & (TBUFSIZE1-1);
+      while (tx1_tail != tx1_head && !(tx1_buf[tx1_tail] & 0x100));
+      tx1_tries = 0;
+   }
+   if (tx1_state == TX1_IDLE && tx1_tail != tx1_head && WWbus) {
+      if (tx1_tries) ++tx1_retries;
+      ++tx1_tries;
+      REN1 = FALSE;                             // disable reception
+      TB8_1 = (tx1_buf[tx1_tail] & 0x100) != 0; // ninth bit
+      SBUF1 = tx1_buf[tx1_tail] & 0xFF;         // lower 8 bits
+      tx1_state = TX1_SENDING;
+   }
+   ES1 = TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// counts down the time left for the acknowledge. called from Timer0_ISR() every
+// 50 milliseconds.
+// ---------------------------------------------------------------------------
+void tx1_tick(void) {
+   if (tx1_ticks) --tx1_ticks;
+}
+
+// ---------------------------------------------------------------------------
+// returns the number of words in the serial 1 transmit buffer, including the one being sent.
+// ---------------------------------------------------------------------------
+unsigned char tx1_count(void) {
+   return ((tx1_head - tx1_tail) & (TBUFSIZE1-1));
+}
+
+// ---------------------------------------------------------------------------
+// returns the number of words that can be put in the serial 1 transmit buffer.
+// ---------------------------------------------------------------------------
+unsigned char tx1_free(void) {
+   return ((TBUFSIZE1-1) - tx1_count());        // one slot is always left empty
+}
+
+// ---------------------------------------------------------------------------
+// finishes the frame serial1_isr() is assembling if no word has come for a whole tick,
+// so a command with WWARGS_ANY arguments, or a response, doesn't wait for the next
+// address word. called from Timer0_ISR() every 50 milliseconds.
+// ---------------------------------------------------------------------------
+void rx1_tick(void) {
+   ES1 = FALSE;
+   if (rx1_open && rx1_quiet) {
+      ISR_MICROS(rx1_closed);
+      rx1_head = (rx1_head+1) & (RFRAMES1-1);
+      rx1_open = FALSE;
+   }
+   rx1_quiet = TRUE;
+   ES1 = TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// returns 1 if there is a finished frame from the Wheelwriter waiting in the serial 1 receive buffer.
+// ---------------------------------------------------------------------------
+char WWframe_avail(void) {
    return (rx1_head != rx1_tail);               // not equal means there's something in the buffer
 }
 
 //----------------------------------------------------------------------------
-// returns the next unsigned integer from the Wheelwriter in the serial 1 receive buffer.
-// waits for an integer to become available if necessary.
+// returns the next frame from the Wheelwriter in the serial 1 receive buffer, waiting
+// for one to be finished if necessary. the frame stays in the buffer, and serial1_isr()
+// leaves it alone, until release_WWframe() is called.
+//
+// the latency is measured from when the frame was finished. that time is only kept for
+// the newest finished frame, in rx1_closed. an older one was finished by the time the
+// frame after it started, which is exact when an address word finished it and otherwise
+// only short by the gap to the next word. a time ahead of the clock is from before a
+// watchdog reset and isn't counted.
 //----------------------------------------------------------------------------
-unsigned int get_WWdata(void) {
-    unsigned int buf;
+ww_frame xdata *get_WWframe(void) {
+    ww_frame xdata *f;
+    unsigned long closed,now;
+    unsigned char next;
 
-    while (rx1_head == rx1_tail);     			// wait until a word is available
-    buf = rx1_buf[rx1_tail];                    // retrieve the word from the buffer
-	if (++rx1_tail == RBUFSIZE1) rx1_tail = 0;  // update the buffer pointer
-    return(buf);
+    while (rx1_head == rx1_tail) hal_poll();	// wait until a frame is available
+    rx1_busy = TRUE;
+    f = &rx1_frames[rx1_tail];
+    next = (rx1_tail+1) & (RFRAMES1-1);
+    ES1 = FALSE;                                // serial1_isr() and rx1_tick() set rx1_closed
+    ET0 = FALSE;
+    closed = (next == rx1_head) ? rx1_closed : rx1_frames[next].time;
+    ET0 = TRUE;
+    ES1 = TRUE;
+    now = micros();
+    if (closed <= now && now - closed > rx1_latency)
+       rx1_latency = now - closed;              // how long the frame waited
+    return(f);
+}
+
+//----------------------------------------------------------------------------
+// gives the frame returned by get_WWframe() back to serial1_isr().
+//----------------------------------------------------------------------------
+void release_WWframe(void) {
+	if (rx1_head != rx1_tail) rx1_tail = (rx1_tail+1) & (RFRAMES1-1);
+    rx1_busy = FALSE;
+}
+
+//----------------------------------------------------------------------------
+// gives the frame returned by get_WWframe() back to serial1_isr() unused, and counts
+// its words in rx1_dropped with the ones lost because the receive buffer was full.
+//----------------------------------------------------------------------------
+void drop_WWframe(void) {
+    if (rx1_head != rx1_tail) {
+       ES1 = FALSE;                             // serial1_isr() adds to rx1_dropped too
+       rx1_dropped += rx1_frames[rx1_tail].count;
+       ES1 = TRUE;
+    }
+    release_WWframe();
+}
+
+///////////////////////////////////// Statistics ////////////////////////////////////////
+
+// ---------------------------------------------------------------------------
+// copies the serial 0 and serial 1 statistics into 'stats'. the serial
+// interrupts are held off while copying so the counts are consistent.
+// ---------------------------------------------------------------------------
+void get_uart_stats(uart_stats xdata *stats) {
+    ES0 = FALSE;
+    ES1 = FALSE;
+    stats->rx0_hiwater = rx0_hiwater;
+    stats->rx0_dropped = rx0_dropped;
+    stats->tx0_hiwater = tx0_hiwater;
+    stats->tx0_stalls = tx0_stalls;
+    stats->rx1_hiwater = rx1_hiwater;
+    stats->rx1_overruns = rx1_overruns;
+    stats->rx1_dropped = rx1_dropped;
+    stats->rx1_acks = rx1_acks;
+    stats->rx1_noacks = rx1_noacks;
+    stats->rx1_latency = rx1_latency;
+    stats->tx1_sent = tx1_sent;
+    stats->tx1_retries = tx1_retries;
+    stats->tx1_failed = tx1_failed;
+    ES1 = TRUE;
+    ES0 = TRUE;
 }
 
+// ---------------------------------------------------------------------------
+// sets all the serial 0 and serial 1 statistics back to zero.
+// ---------------------------------------------------------------------------
+void clear_uart_stats(void) {
+    ES0 = FALSE;
+    ES1 = FALSE;
+    rx0_hiwater = 0;
+    rx0_dropped = 0;
+    tx0_hiwater = 0;
+    tx0_stalls = 0;
+    rx1_hiwater = 0;
+    rx1_overruns = 0;
+    rx1_dropped = 0;
+    rx1_acks = 0;
+    rx1_noacks = 0;
+    rx1_latency = 0;
+    tx1_sent = 0;
+    tx1_retries = 0;
+    tx1_failed = 0;
+    ES1 = TRUE;
+    ES0 = TRUE;
+}
@@ -1,9 +1,42 @@
+// serial 0 and serial 1 statistics
+typedef struct {
+    unsigned char rx0_hiwater;          // most characters ever waiting in the serial 0 receive buffer
+    unsigned int  rx0_dropped;          // characters lost because the serial 0 receive buffer was full
+    unsigned char tx0_hiwater;          // most characters ever waiting in the serial 0 transmit buffer
+    unsigned int  tx0_stalls;           // number of times putchar() waited for room in the transmit buffer
+    unsigned char rx1_hiwater;          // most frames ever waiting in the serial 1 receive buffer
+    unsigned int  rx1_overruns;         // number of times the serial 1 receive buffer filled up
+    unsigned long rx1_dropped;          // BUS words lost because the serial 1 receive buffer was full or a capture was being dumped
+    unsigned long rx1_acks;             // acknowledge words received
+    unsigned int  rx1_noacks;           // BUS words that weren't followed by an acknowledge
+    unsigned long rx1_latency;          // most microseconds from a frame being finished to get_WWframe()
+    unsigned long tx1_sent;             // words sent on the BUS and acknowledged
+    unsigned long tx1_retries;          // words sent again because there was no acknowledge
+    unsigned int  tx1_failed;           // words given up on after TX1_RETRIES tries
+} uart_stats;
+
 // uart.c function prototypes...
 void init_serial0(unsigned int baudrate);
-void init_serial1(void);
+unsigned int init_serial1(bit warm);
 char char_avail(void);
+void serial0_flow(bit on);
 char getchar(void);
 char putchar(char c);
-void send_WWdata(unsigned int wwCommand);
-char WWdata_avail(void);
-unsigned int get_WWdata(void);
\ No newline at end of file
+unsigned char write_serial0(char *buf, unsigned char len);
+unsigned char tx0_count(void);
+unsigned char tx0_free(void);
+void flush_serial0(void);
+bit send_WWdata(unsigned int wwCommand);
+void tx1_service(void);
+void tx1_tick(void);
+unsigned char tx1_count(void);
+unsigned char tx1_free(void);
+void rx1_tick(void);
+char WWframe_avail(void);
+ww_frame xdata *get_WWframe(void);
+void release_WWframe(void);
+void drop_WWframe(void);
+void get_uart_stats(uart_stats xdata *stats);
+void clear_uart_stats(void);
+
+extern bit ack_filter;                  // TRUE to discard the acknowledge words from the Printer Board
@@ -1,4 +1,4 @@
-#include <reg420.h>
+#include "hal.h"
 
 // clear watchdog timer flag
 void clr_watchdog() {  
@@ -31,23 +31,24 @@ void reset_watchdog() {
     RWT = 1;						// reset the watchdog timer
 }
 
-// initialize watchdog timer, set watchdog interval
+// initialize watchdog timer, set watchdog interval. the interval is a number of clocks,
+// so it scales with FOSC, see WATCHDOG_MS() in clock.h
 void init_watchdog(unsigned char interval) {
     switch (interval) {
         case 0:
-            CKCON = (CKCON & 0x3F);   		// WD1:0 = 00  WD interval = (1/11.059MHz)*2^17 =   11.8 milliseconds
+            CKCON = (CKCON & 0x3F);   		// WD1:0 = 00  WD interval = 2^17 clocks, 10.9 milliseconds at 12 MHz
             break;
         case 1:
-            CKCON = (CKCON & 0x3F) | 0x40;	// WD1:0 = 01  WD interval = (1/11.059MHz)*2^20 =   94.8 milliseconds
+            CKCON = (CKCON & 0x3F) | 0x40;	// WD1:0 = 01  WD interval = 2^20 clocks, 87.4 milliseconds at 12 MHz
             break;
         case 2:
-            CKCON = (CKCON & 0x3F) | 0x80;	// WD1:0 = 10  WD interval = (1/11.059MHz)*2^23 =  758.5 milliseconds
+            CKCON = (CKCON & 0x3F) | 0x80;	// WD1:0 = 10  WD interval = 2^23 clocks,  699 milliseconds at 12 MHz
             break;
         case 3:
-            CKCON = (CKCON | 0xC0);   		// WD1:0 = 11  WD interval = (1/11.059MHz)*2^26 = 6068.1 milliseconds
+            CKCON = (CKCON | 0xC0);   		// WD1:0 = 11  WD interval = 2^26 clocks, 5592 milliseconds at 12 MHz
             break;
         default:
-            CKCON = (CKCON | 0xC0);   		// WD1:0 = 11  WD interval = (1/11.059MHz)*2^26 = 6068.1 milliseconds
+            CKCON = (CKCON | 0xC0);   		// WD1:0 = 11  WD interval = 2^26 clocks, 5592 milliseconds at 12 MHz
    }
   reset_watchdog();                	// reset watchdog timer
   enable_watchdog();               	// enable watchdog reset
@@ -0,0 +1,187 @@
+// Wheelwriter BUS protocol decoder.
+//
+// The command table is expanded from wwbus.def at compile time, so decoding a word is a
+// single table lookup no matter how many commands there are. Words with the ninth bit set
+// are address words: 0x121 starts a command for the Printer Board and any other address
+// word ends it. The word after 0x121 is the command word, which selects how many argument
+// words follow.
+
+#include "hal.h"
+#include "wwproto.h"
+#include "reader.h"
+
+#define FALSE 0
+#define TRUE  1
+
+#define CR    0x0D
+#define BS    0x08
+#define TAB   0x09
+#define SPACE 0x20
+
+#define WW_IDLE      0                  // waiting for 0x121
+#define WW_COMMAND   1                  // 0x121 received, waiting for the command word
+#define WW_ARGUMENTS 2                  // collecting argument words
+
+#define WWCMD(command,arguments,action,name) {arguments,action},
+code const ww_cmdinfo ww_cmdtable[WWCMDS+1] = {
+#include "wwbus.def"
+    {WWARGS_ANY,ACT_OTHER}              // WWUNKNOWN
+};
+#undef WWCMD
+
+#define WWCMD(command,arguments,action,name) name,
+const char code * code ww_cmdname[WWCMDS+1] = {
+#include "wwbus.def"
+    "unknown"
+};
+#undef WWCMD
+
+// convert printwheel character to ASCII
+code const char printwheel[96] = {
+// a    n    r    m    c    s    d    h    l    f    k    ,    V    _    G    U  
+  0x61,0x6E,0x72,0x6D,0x63,0x73,0x64,0x68,0x6C,0x66,0x6B,0x2C,0x56,0x2D,0x47,0x55,
+// F    B    Z    H    P    )    R    L    S    N    C    T    D    E    I    A       
+  0x46,0x42,0x5A,0x48,0x50,0x29,0x52,0x4C,0x53,0x4E,0x43,0x54,0x44,0x45,0x49,0x41,
+// J    O    (    M    .    Y    ,    /    W    9    K    3    X    1    2    0 
+  0x4A,0x4F,0x28,0x4D,0x2E,0x59,0x2C,0x2F,0x57,0x39,0x4B,0x33,0x58,0x31,0x32,0x30,
+// 5    4    6    8    7    *    $    #    %    ¢    +    ±    @    Q    &    ]
+  0x35,0x34,0x36,0x38,0x37,0x2A,0x24,0x23,0x25,0xA2,0x2B,0xB1,0x40,0x51,0x26,0x5D,
+// [    ³    ²    º    §    ¶    ½    ¼    !    ?    "    '    =    :    -    ;   
+  0x5B,0xB3,0xB2,0xBA,0xA7,0xB6,0xBD,0xBC,0x21,0x3F,0x22,0x60,0x3D,0x3A,0x5F,0x3B,
+// x    q    v    z    w    j    .    y    b    g    u    p    i    t    o    e   
+  0x78,0x71,0x76,0x7A,0x77,0x6A,0x2E,0x79,0x62,0x67,0x75,0x70,0x69,0x74,0x6F,0x65};  
+
+// convert ASCII 0x20 to 0x7E to printwheel character, the reverse of printwheel[]. 0 is
+// SPACE and also stands in for the characters that aren't on the printwheel. the
+// apostrophe is the printwheel character printwheel[] shows as a grave accent.
+code const unsigned char ascii_printwheel[95] = {
+//      !    "    #    $    %    &    '    (    )    *    +    ,    -    .    /
+  0x00,0x49,0x4B,0x38,0x37,0x39,0x3F,0x4C,0x23,0x16,0x36,0x3B,0x0C,0x0E,0x25,0x28,
+// 0    1    2    3    4    5    6    7    8    9    :    ;    <    =    >    ?
+  0x30,0x2E,0x2F,0x2C,0x32,0x31,0x33,0x35,0x34,0x2A,0x4E,0x50,0x00,0x4D,0x00,0x4A,
+// @    A    B    C    D    E    F    G    H    I    J    K    L    M    N    O
+  0x3D,0x20,0x12,0x1B,0x1D,0x1E,0x11,0x0F,0x14,0x1F,0x21,0x2B,0x18,0x24,0x1A,0x22,
+// P    Q    R    S    T    U    V    W    X    Y    Z    [    \    ]    ^    _
+  0x15,0x3E,0x17,0x19,0x1C,0x10,0x0D,0x29,0x2D,0x26,0x13,0x41,0x00,0x40,0x00,0x4F,
+// `    a    b    c    d    e    f    g    h    i    j    k    l    m    n    o
+  0x4C,0x01,0x59,0x05,0x07,0x60,0x0A,0x5A,0x08,0x5D,0x56,0x0B,0x09,0x04,0x02,0x5F,
+// p    q    r    s    t    u    v    w    x    y    z    {    |    }    ~
+  0x5C,0x52,0x03,0x06,0x5E,0x5B,0x53,0x55,0x51,0x58,0x54,0x00,0x00,0x00,0x00};
+
+//------------------------------------------------------------------------------------------
+// puts the decoder in the state it is after reset: waiting for 0x121.
+//------------------------------------------------------------------------------------------
+void ww_decode_init(ww_decoder xdata *d) {
+    d->state = WW_IDLE;
+    d->want = 0;
+    d->nargs = 0;
+}
+
+//------------------------------------------------------------------------------------------
+// feeds one word from the BUS to the decoder. returns TRUE when the word completes a
+// command, which is then described by d->cmd, d->index, d->action and d->arg[]. commands
+// with WWARGS_ANY arguments are completed by the address word that follows them.
+//------------------------------------------------------------------------------------------
+bit ww_decode(ww_decoder xdata *d, unsigned int w) {
+    bit done = FALSE;
+
+    if (w & 0x100) {                    // address word, ends whatever came before
+       if (d->state == WW_ARGUMENTS && d->want == WWARGS_ANY)
+          done = TRUE;
+       d->state = (w == WWADDRESS) ? WW_COMMAND : WW_IDLE;
+       return (done);
+    }
+
+    if (d->state == WW_COMMAND) {       // 0x121 received, this is the command word
+       d->cmd = w;
+       d->index = WWCMDINDEX(w);
+       d->action = ww_cmdtable[d->index].action;
+       d->want = ww_cmdtable[d->index].args;
+       d->nargs = 0;
+       if (d->want) {
+          d->state = WW_ARGUMENTS;
+       }
+       else {
+          d->state = WW_IDLE;
+          done = TRUE;
+       }
+    }
+    else if (d->state == WW_ARGUMENTS) {
+       if (d->nargs < WWMAXARGS) d->arg[d->nargs] = w;
+       if (d->nargs != 0xFF) ++d->nargs;
+       if (d->want != WWARGS_ANY && !--d->want) {
+          d->state = WW_IDLE;
+          done = TRUE;
+       }
+    }
+    return (done);                      // data words in WW_IDLE are ignored
+}
+
+//------------------------------------------------------------------------------------------
+// describes the command in frame 'f' in d->cmd, d->index, d->action and d->arg[] the way
+// ww_decode() does, without disturbing a command ww_decode() is in the middle of. returns
+// FALSE if the frame isn't a complete command for the Printer Board. a frame with
+// acknowledges in it may hold only part of a command, so it is left to ww_decode().
+//------------------------------------------------------------------------------------------
+bit ww_decode_frame(ww_decoder xdata *d, ww_frame xdata *f) {
+    unsigned char i;
+
+    if (!(f->flags & WWFRAME_ADDRESS) || f->w[0] != (WWADDRESS & 0xFF) || f->count < 2 || (f->flags & WWFRAME_ACKS))
+       return (FALSE);
+    d->cmd = f->w[1];
+    d->index = WWCMDINDEX(f->w[1]);
+    d->action = ww_cmdtable[d->index].action;
+    d->nargs = f->count - 2;
+    if (ww_cmdtable[d->index].args != WWARGS_ANY && d->nargs < ww_cmdtable[d->index].args)
+       return (FALSE);                  // cut short by the next address word
+    for (i = 0; i < d->nargs && i < WWMAXARGS; i++)
+       d->arg[i] = f->w[i+2];
+    return (TRUE);
+}
+
+//------------------------------------------------------------------------------------------
+// puts the ASCII that the command just completed in 'd' types into 's', the way ASCII
+// mode sends it, and returns how many characters that is, 0 to 2. 'pitch' is the
+// microspaces per character, for telling a space from a tab. a new line is CR.
+//------------------------------------------------------------------------------------------
+unsigned char ww_type(ww_decoder xdata *d, unsigned char pitch, char *s) {
+    unsigned int distance;
+
+    switch (d->action) {
+        case ACT_CHARACTER:         // 0x121,0x003,printwheel code,microspaces
+            if (d->arg[0] && d->arg[0] <= sizeof(printwheel))
+               s[0] = printwheel[d->arg[0]-1];
+            else
+               s[0] = SPACE;        // 0x121,0x003,0x000 is the sequence for SPACE
+            return (1);
+        case ACT_ERASE:             // 0x121,0x004,printwheel code,microspaces
+            s[0] = SPACE;           // overwrite the character with space
+            s[1] = BS;
+            return (2);
+        case ACT_VERTICAL:          // 0x121,0x005,direction and microlines
+            if ((d->arg[0]&0x1F) != LINESPACING)
+               break;
+            s[0] = CR;              // 0x121,0x005,0x090 is the sequence for paper up one line (for 10P, 12P and PS printwheels)
+            return (1);
+        case ACT_HORIZONTAL:        // 0x121,0x006,direction and microspaces high bits,microspaces low bits
+            distance = ((unsigned int)(d->arg[0]&0x7F)<<8)|d->arg[1];
+            if (d->arg[0] & 0x80) { // 0x121,0x006,0x080 is horizontal movement to the right...
+               s[0] = (distance > pitch) ? TAB : SPACE; // if more than one space, must be tab
+               return (1);
+            }
+            if (distance != pitch)  // 0x121,0x006,0x000 is horizontal movement to the left...
+               break;
+            s[0] = BS;
+            return (1);
+    }
+    return (0);
+}
+
+//------------------------------------------------------------------------------------------
+// returns word 'i' of frame 'f' with its ninth bit.
+//------------------------------------------------------------------------------------------
+unsigned int ww_frame_word(ww_frame xdata *f, unsigned char i) {
+    if (!i && (f->flags & WWFRAME_ADDRESS))
+       return (0x100 | f->w[0]);
+    return (f->w[i]);
+}
@@ -0,0 +1,75 @@
+// Wheelwriter BUS protocol decoder. The command set is described in wwbus.def.
+
+#ifndef WWPROTO_H
+#define WWPROTO_H
+
+#define WWADDRESS  0x121                // address word that starts every command to the Printer Board
+#define WWCMDFIRST 0x003                // command words WWCMDFIRST to WWCMDFIRST+WWCMDS-1 are in wwbus.def
+#define WWCMDS     4
+#define WWUNKNOWN  WWCMDS               // table index used for every other command word
+#define WWCMDINDEX(w) ((unsigned int)((w)-WWCMDFIRST) < WWCMDS ? (w)-WWCMDFIRST : WWUNKNOWN)
+#define WWARGS_ANY 0xFF                 // argument count for commands that run to the next 0x121
+#define WWMAXARGS  4                    // argument words kept for each command, extras are counted but dropped
+#define WWFRAMEWORDS (2+WWMAXARGS)      // words in a frame: 0x121, the command word and its arguments
+
+#define WWFRAME_ADDRESS  0x01           // frame flags: the first word is an address word, w[0] holds its low 8 bits
+#define WWFRAME_RESPONSE 0x02           // the words came from the Printer Board, not the Function Board
+#define WWFRAME_ACK(i)   (0x04<<(i))    // w[i] is an acknowledge, kept with "ack off"
+#define WWFRAME_ACKS     0xFC           // any of the WWFRAME_ACK() flags
+
+#if WWFRAMEWORDS > 6
+#error "the WWFRAME_ACK() flags only have room for 6 words in a frame"
+#endif
+
+enum ww_action {
+    ACT_OTHER,                          // no effect on the ASCII output
+    ACT_CHARACTER,                      // print a character
+    ACT_ERASE,                          // erase a character
+    ACT_VERTICAL,                       // move the paper
+    ACT_HORIZONTAL                      // move the carrier
+};
+
+// one entry of the lookup table generated from wwbus.def
+typedef struct {
+    unsigned char args;                 // number of argument words, WWARGS_ANY = up to the next 0x121
+    unsigned char action;               // enum ww_action
+} ww_cmdinfo;
+
+// decoder state and the most recently completed command
+typedef struct {
+    unsigned char state;                // WW_IDLE, WW_COMMAND or WW_ARGUMENTS
+    unsigned char want;                 // argument words still expected
+    unsigned char index;                // table index of the command, WWUNKNOWN for command words not in the table
+    unsigned char action;               // enum ww_action
+    unsigned int  cmd;                  // the command word
+    unsigned char nargs;                // argument words received, may be more than WWMAXARGS
+    unsigned char arg[WWMAXARGS];       // argument words (all argument words are 8 bits)
+} ww_decoder;
+
+// the words of one command as they came off the BUS, see serial1_isr(). a frame starts
+// with an address word and holds the command word and its arguments, as many as
+// ww_cmdtable[] says, or everything up to the next address word for WWARGS_ANY. words
+// from the Printer Board after the arguments, other than acknowledges, make frames of
+// their own flagged WWFRAME_RESPONSE. a frame that would be longer than WWFRAMEWORDS is
+// carried on in another frame without WWFRAME_ADDRESS. acknowledges are only kept with
+// "ack off", and are marked with WWFRAME_ACK() since a zero argument word looks the same.
+typedef struct {
+    unsigned long time;                 // arrival time of the first word in microseconds
+    unsigned char flags;                // WWFRAME_xxx
+    unsigned char count;                // words in the frame, 1 to WWFRAMEWORDS
+    unsigned char w[WWFRAMEWORDS];      // bits 7-0 of each word, bit 8 is set only on an address word
+    unsigned int  gap[WWFRAMEWORDS-1];  // microseconds from each word to the next, at most 65535
+} ww_frame;
+
+extern code const ww_cmdinfo ww_cmdtable[WWCMDS+1];
+extern const char code * code ww_cmdname[WWCMDS+1];
+extern code const char printwheel[96];  // printwheel codes 1 to 96 to ASCII
+extern code const unsigned char ascii_printwheel[95];   // ASCII 0x20 to 0x7E to printwheel codes
+
+void ww_decode_init(ww_decoder xdata *d);
+bit ww_decode(ww_decoder xdata *d, unsigned int w);
+bit ww_decode_frame(ww_decoder xdata *d, ww_frame xdata *f);
+unsigned int ww_frame_word(ww_frame xdata *f, unsigned char i);
+unsigned char ww_type(ww_decoder xdata *d, unsigned char pitch, char *s);
+
+#endif